@@ -0,0 +1,39 @@
+#include "bloomfilter.h"
+#include "packedkey.h"
+
+// odd multipliers that spread one hash over the words of a block
+static const uint32_t SALTS[BLOOMWORDS] = {
+    0x47B6137BU, 0x44974D91U, 0x8824AD5BU, 0xA2B7289DU,
+    0x705495C7U, 0x2DF1424BU, 0x9EFC4947U, 0x5C6BFB31U
+};
+
+BloomFilter::BloomFilter(size_t cap){
+    m_count = (cap * BLOOMBYTESPER + sizeof(Block) - 1) / sizeof(Block);
+    if (m_count == 0)
+        m_count = 1;
+    m_blocks = new Block[m_count](); // every bit starts clear
+}
+
+BloomFilter::~BloomFilter(){
+    delete [] m_blocks;
+}
+
+uint64_t BloomFilter::bitOf(uint64_t h, int i){
+    return uint64_t(1) << ((uint32_t(h) * SALTS[i]) >> 26);
+}
+
+void BloomFilter::add(unsigned int hash){
+    uint64_t h = mix64(hash); // a hash_fn can be weak, the block and bits need all of its bits mixed
+    Block& block = m_blocks[blockIndex(h)];
+    for (int i = 0; i < BLOOMWORDS; i++)
+        block.words[i] |= bitOf(h, i);
+}
+
+bool BloomFilter::mayContain(unsigned int hash) const{
+    uint64_t h = mix64(hash);
+    const Block& block = m_blocks[blockIndex(h)];
+    bool all = true;
+    for (int i = 0; i < BLOOMWORDS; i++) // no early exit, the 8 tests compile to straight-line code
+        all &= (block.words[i] & bitOf(h, i)) != 0;
+    return all;
+}
@@ -0,0 +1,38 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+const int BLOOMWORDS = 8;       // 64-bit words in a block, a block is one cache line
+const int BLOOMBYTESPER = 1;    // filter bytes per table slot, 16 bits per key at a load of 0.5
+
+// split block Bloom filter over key hashes: a key picks one 512-bit block and sets one bit in each
+// of its 8 words, so a test reads a single cache line. With 16 bits per key about 0.1% of the
+// keys that were never added pass. Keys cannot be taken out; a removed key keeps passing, which only
+// costs a probe that finds nothing, until a rehash or enough removes make VDetect build a new filter.
+class BloomFilter{
+public:
+    friend class Grader;
+    friend class Tester;
+    // sized for a table of cap slots
+    explicit BloomFilter(size_t cap);
+    ~BloomFilter();
+    BloomFilter(const BloomFilter&) = delete;
+    BloomFilter& operator=(const BloomFilter&) = delete;
+    void add(unsigned int hash);
+    // false only if hash was never added
+    bool mayContain(unsigned int hash) const;
+    size_t bytes() const {return m_count * sizeof(Block);}
+
+private:
+    struct alignas(BLOOMWORDS * sizeof(uint64_t)) Block{
+        uint64_t words[BLOOMWORDS];
+    };
+    Block* m_blocks;
+    size_t m_count;     // number of blocks
+
+    size_t blockIndex(uint64_t h) const {return ((h >> 32) * m_count) >> 32;}
+    // the bit of word i a key sets
+    static uint64_t bitOf(uint64_t h, int i);
+};
+#endif
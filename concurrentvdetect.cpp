@@ -0,0 +1,185 @@
+#include "concurrentvdetect.h"
+#include <cstring>
+#include <thread>
+
+ConcurrentVDetect::ConcurrentVDetect(size_t size, hash_fn hash, prob_t probing, size_t shards, cap_t capacity){
+    if (shards == 0) {
+        shards = 4 * thread::hardware_concurrency();
+    }
+    m_numShards = 1;
+    while (m_numShards < shards) {
+        m_numShards *= 2;
+    }
+
+    m_hash = hash;
+    m_shards = new Shard[m_numShards];
+    for (size_t i = 0; i < m_numShards; i++) { // every shard starts with its part of the requested size
+        m_shards[i].table = new VDetect(size / m_numShards, hash, probing, capacity);
+        m_shards[i].table->m_epoch = &EpochDomain::instance();
+        m_shards[i].seq.store(0, memory_order_relaxed);
+        m_shards[i].view.store(new ShardView(viewOf(*m_shards[i].table)), memory_order_release);
+    }
+}
+
+ConcurrentVDetect::~ConcurrentVDetect(){
+    for (size_t i = 0; i < m_numShards; i++) {
+        delete m_shards[i].view.load(memory_order_relaxed);
+        delete m_shards[i].table;
+    }
+    delete [] m_shards;
+}
+
+bool ConcurrentVDetect::insert(const Virus& virus){
+    PackedKey packed(virus.getKey());
+    unsigned int hash = hashKey(virus.getKey(), packed);
+    Shard& shard = shardOf(hash);
+    lock_guard<mutex> guard(shard.lock);
+    beginWrite(shard);
+    bool done = shard.table->insertPacked(packed, hash, virus.getID());
+    endWrite(shard);
+    return done;
+}
+
+bool ConcurrentVDetect::remove(const Virus& virus){
+    PackedKey packed(virus.getKey());
+    unsigned int hash = hashKey(virus.getKey(), packed);
+    Shard& shard = shardOf(hash);
+    lock_guard<mutex> guard(shard.lock);
+    beginWrite(shard);
+    bool done = shard.table->removePacked(packed, hash, virus.getID());
+    endWrite(shard);
+    return done;
+}
+
+Virus ConcurrentVDetect::getVirus(const string& key, int id) const{
+    PackedKey packed(key);
+    if (lookup(packed, hashKey(key, packed), id))
+        return Virus(key, id);
+    return EMPTY;
+}
+
+bool ConcurrentVDetect::contains(string_view key, int id) const{
+    PackedKey packed(key);
+    return lookup(packed, hashKey(key, packed), id);
+}
+
+bool ConcurrentVDetect::lookup(const PackedKey& packed, unsigned int hash, int id) const{
+    const Shard& shard = shardOf(hash);
+    EpochGuard guard(EpochDomain::instance()); // keeps retired tables and key words alive until we leave
+    for (;;) {
+        uint64_t seq = shard.seq.load(memory_order_acquire);
+        if (seq & 1) { // a writer is inside the shard
+            this_thread::yield();
+            continue;
+        }
+        const VDetect* vdetect = shard.table; // set once, m_capMode and m_stash never move
+        const ShardView* shardView = shard.view.load(memory_order_acquire);
+        cap_t mode = vdetect->m_capMode;
+
+        bool found = false;
+        bool retry = false;
+        for (int t = 0; t < 2 && !found && !retry; t++) {
+            const TableView& view = shardView->tables[t];
+            if (view.table == nullptr)
+                continue;
+            size_t index = withPolicy(view.probing, mode, [&](auto policy) {
+                typedef decltype(policy) P;
+                return probeFind<typename P::Probe, P::mode>(view.table, view.ctrl, view.cap, hash,
+                    [&](const Slot& slot) {return readerMatches(slot, packed, hash, id, shard, seq, retry);});
+            });
+            found = index != NOSLOT && !retry;
+        }
+        for (size_t i = 0; i < shardView->stashed && !found && !retry; i++) {
+            found = readerMatches(vdetect->m_stash[i], packed, hash, id, shard, seq, retry) && !retry;
+        }
+        // a writer that ran during the probe may have moved the entry between the tables
+        if (retry || !unchanged(shard, seq))
+            continue;
+        return found;
+    }
+}
+
+void ConcurrentVDetect::changeProbPolicy(prob_t policy){
+    for (size_t i = 0; i < m_numShards; i++) {
+        lock_guard<mutex> guard(m_shards[i].lock);
+        beginWrite(m_shards[i]);
+        m_shards[i].table->changeProbPolicy(policy);
+        endWrite(m_shards[i]);
+    }
+}
+
+size_t ConcurrentVDetect::size() const{
+    size_t live = 0;
+    for (size_t i = 0; i < m_numShards; i++) {
+        lock_guard<mutex> guard(m_shards[i].lock);
+        live += m_shards[i].table->liveCount();
+    }
+    return live;
+}
+
+ConcurrentVDetect::Shard& ConcurrentVDetect::shardOf(unsigned int hash) const{
+    hash ^= hash >> 16; // murmur3 finalizer, the low bits pick the shard
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return m_shards[hash & (m_numShards - 1)];
+}
+
+unsigned int ConcurrentVDetect::hashKey(string_view key, const PackedKey& packed) const{
+    if (m_hash == packedHashCode)
+        return packed.hash();
+    return m_hash(string(key));
+}
+
+void ConcurrentVDetect::beginWrite(Shard& shard){
+    shard.seq.store(shard.seq.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // the odd value is visible before any table write
+}
+
+void ConcurrentVDetect::endWrite(Shard& shard){
+    const ShardView* last = shard.view.load(memory_order_relaxed);
+    ShardView now = viewOf(*shard.table);
+    bool same = now.stashed == last->stashed; // most writes leave the tables and the stash as they were
+    for (int t = 0; t < 2; t++) {
+        same = same && now.tables[t].table == last->tables[t].table && now.tables[t].ctrl == last->tables[t].ctrl &&
+               now.tables[t].cap == last->tables[t].cap && now.tables[t].probing == last->tables[t].probing;
+    }
+    if (!same) {
+        shard.view.store(new ShardView(now), memory_order_release);
+        EpochDomain::instance().retire(const_cast<ShardView*>(last),
+            [](void* view) {delete static_cast<ShardView*>(view);});
+    }
+    shard.seq.store(shard.seq.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+ConcurrentVDetect::ShardView ConcurrentVDetect::viewOf(const VDetect& vdetect){
+    ShardView view;
+    view.tables[0] = {vdetect.m_currentTable, vdetect.m_currentCtrl, vdetect.m_currentCap, vdetect.m_currProbing};
+    view.tables[1] = {vdetect.m_oldTable, vdetect.m_oldCtrl, vdetect.m_oldCap, vdetect.m_oldProbing};
+    view.stashed = vdetect.m_stashSize;
+    return view;
+}
+
+bool ConcurrentVDetect::unchanged(const Shard& shard, uint64_t seq){
+    atomic_thread_fence(memory_order_acquire); // the reads before this can not move past the check
+    return shard.seq.load(memory_order_relaxed) == seq;
+}
+
+bool ConcurrentVDetect::readerMatches(const Slot& slot, const PackedKey& key, unsigned int hash, int id,
+                                      const Shard& shard, uint64_t seq, bool& retry){
+    if (__atomic_load_n(&slot.m_hash, __ATOMIC_RELAXED) != hash || __atomic_load_n(&slot.m_id, __ATOMIC_RELAXED) != id)
+        return false;
+    if (__atomic_load_n(&slot.m_key.m_length, __ATOMIC_RELAXED) != key.m_length ||
+        __atomic_load_n(&slot.m_key.m_kind, __ATOMIC_RELAXED) != key.m_kind)
+        return false;
+    uint64_t word = __atomic_load_n(&slot.m_key.m_word, __ATOMIC_RELAXED);
+    if (key.isInline())
+        return word == key.m_word;
+    // word is a pointer, it belongs to a key of this length only if no writer came in between
+    if (!unchanged(shard, seq)) {
+        retry = true;
+        return true; // stops the probe, the caller starts over
+    }
+    return memcmp(reinterpret_cast<const uint64_t*>(word), key.m_words, key.wordCount() * sizeof(uint64_t)) == 0;
+}
@@ -0,0 +1,73 @@
+#ifndef CONCURRENTVDETECT_H
+#define CONCURRENTVDETECT_H
+#include <atomic>
+#include <mutex>
+#include "vdetect.h"
+#include "epoch.h"
+
+// VDetect that can be shared by many threads. Entries are split into shards by hash, every shard is a
+// VDetect whose writers are serialized by a mutex, so writers only block their own shard.
+// Lookups take no lock: every shard has a sequence counter that is odd while a writer is inside,
+// a reader loads the view of the shard's tables the last writer published, probes, and starts over
+// if the counter moved. Views are never changed once published. Old tables, views and key words a
+// writer drops are retired to the epoch domain, so a reader that raced with the writer never
+// touches freed memory.
+class ConcurrentVDetect{
+public:
+    friend class Grader;
+    friend class Tester;
+    // shards is rounded up to a power of two, 0 picks four shards per hardware thread
+    ConcurrentVDetect(size_t size, hash_fn hash, prob_t probing, size_t shards = 0, cap_t capacity = DEFCAP);
+    ~ConcurrentVDetect();
+    bool insert(const Virus& virus);
+    bool remove(const Virus& virus);
+    Virus getVirus(const string& key, int id) const;
+    // lock-free lookup that builds no string
+    bool contains(string_view key, int id) const;
+    // request a change in collision handling policy for every shard
+    void changeProbPolicy(prob_t policy);
+    // number of live entries over all shards
+    size_t size() const;
+
+private:
+    // one table of a shard
+    struct TableView{
+        const Slot*   table;
+        const ctrl_t* ctrl;
+        size_t        cap;
+        prob_t        probing;
+    };
+    // the fields of a shard's VDetect that readers need, as a writer left them
+    struct ShardView{
+        TableView tables[2];        // current, old; the old table is nullptr when no rehash runs
+        size_t    stashed;          // entries in the stash
+    };
+    struct alignas(CACHELINE) Shard{
+        mutex            lock;      // held by insert, remove and policy changes
+        atomic<uint64_t> seq;       // odd while a writer is changing the table
+        atomic<const ShardView*> view; // replaced by endWrite when the tables changed
+        VDetect* table;
+    };
+
+    hash_fn m_hash;         // hash function, called once per operation
+    Shard*  m_shards;
+    size_t  m_numShards;    // always a power of two
+
+    // shard of a hash, uses different bits than the home slot inside the shard
+    Shard& shardOf(unsigned int hash) const;
+    unsigned int hashKey(string_view key, const PackedKey& packed) const;
+    // lock-free probe of the shard of hash, true when key/id is in it
+    bool lookup(const PackedKey& packed, unsigned int hash, int id) const;
+    // writers bracket every change of a shard with these, endWrite publishes a new view first
+    static void beginWrite(Shard& shard);
+    static void endWrite(Shard& shard);
+    // the view of the shard's VDetect as it is now
+    static ShardView viewOf(const VDetect& vdetect);
+    // true when no writer entered the shard since the reader read seq
+    static bool unchanged(const Shard& shard, uint64_t seq);
+    // compares a slot a writer may be changing, every field is read once and the key
+    // words are only followed after the snapshot is validated; sets retry when it was not
+    static bool readerMatches(const Slot& slot, const PackedKey& key, unsigned int hash, int id,
+                              const Shard& shard, uint64_t seq, bool& retry);
+};
+#endif
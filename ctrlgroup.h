@@ -0,0 +1,108 @@
+#ifndef CTRLGROUP_H
+#define CTRLGROUP_H
+#include <cstddef>
+#include <cstdint>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+// one control byte per table slot:
+// a live slot stores a 7-bit fragment of its hash (0..127),
+// EMPTY and DELETED slots store negative markers so one sign bit tells them apart
+typedef int8_t ctrl_t;
+const ctrl_t CTRLEMPTY = -128;
+const ctrl_t CTRLDELETED = -2;
+const int GROUPWIDTH = 16;  // slots scanned by one group compare
+
+// 7-bit fragment kept in the control byte, taken from the top bits of the mixed hash
+inline ctrl_t hashFragment(unsigned int hash){
+    return ctrl_t((hash * 0x9E3779B1u) >> 25);
+}
+
+// index of the lowest set bit of a non zero group mask
+inline int lowestBit(uint32_t mask){
+    return __builtin_ctz(mask);
+}
+
+// the control bytes of GROUPWIDTH consecutive slots, every match returns a bit mask
+// with bit i set when the i-th slot of the group matches
+class Group{
+public:
+#ifdef __SSE2__
+    explicit Group(const ctrl_t* pos) : m_ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+    uint32_t match(ctrl_t fragment) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(fragment), m_ctrl));
+    }
+    uint32_t matchEmptyOrDeleted() const {return _mm_movemask_epi8(m_ctrl);}
+#else
+    explicit Group(const ctrl_t* pos) : m_pos(pos) {}
+    uint32_t match(ctrl_t fragment) const {
+        uint32_t mask = 0;
+        for (int i = 0; i < GROUPWIDTH; i++)
+            mask |= uint32_t(m_pos[i] == fragment) << i;
+        return mask;
+    }
+    uint32_t matchEmptyOrDeleted() const {
+        uint32_t mask = 0;
+        for (int i = 0; i < GROUPWIDTH; i++)
+            mask |= uint32_t(m_pos[i] < 0) << i;
+        return mask;
+    }
+#endif
+    uint32_t matchEmpty() const {return match(CTRLEMPTY);}
+
+private:
+#ifdef __SSE2__
+    __m128i m_ctrl;
+#else
+    const ctrl_t* m_pos;
+#endif
+};
+
+// allocates control bytes for a table of cap slots, every slot starts EMPTY
+// the first GROUPWIDTH-1 bytes are repeated past the end so a group read never wraps
+inline ctrl_t* newCtrl(size_t cap){
+    ctrl_t* ctrl = new ctrl_t[cap + GROUPWIDTH - 1];
+    for (size_t i = 0; i < cap + GROUPWIDTH - 1; i++)
+        ctrl[i] = CTRLEMPTY;
+    return ctrl;
+}
+
+// updates the control byte of a slot and its copy past the end of the table
+inline void setCtrl(ctrl_t* ctrl, size_t cap, size_t index, ctrl_t value){
+    ctrl[index] = value;
+    if (index < GROUPWIDTH - 1)
+        ctrl[cap + index] = value;
+}
+
+// one bit per slot, set for live slots, so a scan skips 64 EMPTY or DELETED slots per word
+inline uint64_t* newOccupancy(size_t cap){
+    size_t words = (cap + 63) / 64;
+    uint64_t* occupied = new uint64_t[words];
+    for (size_t i = 0; i < words; i++)
+        occupied[i] = 0;
+    return occupied;
+}
+
+inline void setOccupied(uint64_t* occupied, size_t index, bool live){
+    uint64_t bit = uint64_t(1) << (index % 64);
+    if (live)
+        occupied[index / 64] |= bit;
+    else
+        occupied[index / 64] &= ~bit;
+}
+
+// first live slot at or after from, cap if there is none
+inline size_t nextOccupied(const uint64_t* occupied, size_t cap, size_t from){
+    size_t words = (cap + 63) / 64;
+    size_t word = from / 64;
+    if (word >= words)
+        return cap;
+    uint64_t mask = occupied[word] & (~uint64_t(0) << (from % 64));
+    while (mask == 0) {
+        if (++word == words)
+            return cap;
+        mask = occupied[word];
+    }
+    return word * 64 + __builtin_ctzll(mask);
+}
+#endif
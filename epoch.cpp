@@ -0,0 +1,101 @@
+#include "epoch.h"
+#include <thread>
+
+// claims a reader slot for the thread on first use and gives it back when the thread ends
+class ReaderHandle{
+public:
+    ReaderHandle(){
+        EpochDomain& domain = EpochDomain::instance();
+        for (;;) {
+            for (int i = 0; i < MAXREADERS; i++) {
+                bool expected = false;
+                if (!domain.m_readers[i].used.load(memory_order_relaxed) &&
+                    domain.m_readers[i].used.compare_exchange_strong(expected, true)) {
+                    m_reader = &domain.m_readers[i];
+                    return;
+                }
+            }
+            this_thread::yield(); // every slot is taken, wait for a thread to end
+        }
+    }
+    ~ReaderHandle(){
+        m_reader->epoch.store(0, memory_order_release);
+        m_reader->used.store(false, memory_order_release);
+    }
+    EpochDomain::Reader* m_reader;
+};
+
+EpochDomain::EpochDomain(){
+    for (int i = 0; i < MAXREADERS; i++) {
+        m_readers[i].epoch.store(0, memory_order_relaxed);
+        m_readers[i].used.store(false, memory_order_relaxed);
+    }
+    m_epoch.store(1, memory_order_relaxed);
+}
+
+EpochDomain::~EpochDomain(){ // no reader is left at program exit
+    for (size_t i = 0; i < m_retired.size(); i++)
+        m_retired[i].deleter(m_retired[i].ptr);
+}
+
+EpochDomain& EpochDomain::instance(){
+    static EpochDomain domain;
+    return domain;
+}
+
+EpochDomain::Reader& EpochDomain::reader(){
+    static thread_local ReaderHandle handle;
+    return *handle.m_reader;
+}
+
+void EpochDomain::enter(){
+    Reader& self = reader();
+    self.epoch.store(m_epoch.load(memory_order_relaxed), memory_order_relaxed);
+    // pairs with the fence in retire: either the writer sees this reader or the reader sees the unlink
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void EpochDomain::exit(){
+    reader().epoch.store(0, memory_order_release);
+}
+
+void EpochDomain::retire(void* ptr, void (*deleter)(void*)){
+    atomic_thread_fence(memory_order_seq_cst);
+    // readers entering after the increment can not reach ptr anymore
+    uint64_t epoch = m_epoch.fetch_add(1);
+    {
+        lock_guard<mutex> guard(m_retiredLock);
+        m_retired.push_back(Retired{ptr, deleter, epoch});
+    }
+    reclaim();
+}
+
+void EpochDomain::reclaim(){
+    uint64_t oldest = UINT64_MAX; // oldest epoch a reader is still in
+    atomic_thread_fence(memory_order_seq_cst);
+    for (int i = 0; i < MAXREADERS; i++) {
+        uint64_t epoch = m_readers[i].epoch.load(memory_order_acquire);
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    vector<Retired> ready;
+    {
+        lock_guard<mutex> guard(m_retiredLock);
+        size_t kept = 0;
+        for (size_t i = 0; i < m_retired.size(); i++) {
+            if (m_retired[i].epoch < oldest)
+                ready.push_back(m_retired[i]);
+            else
+                m_retired[kept++] = m_retired[i];
+        }
+        m_retired.resize(kept);
+    }
+    for (size_t i = 0; i < ready.size(); i++) // deleters run outside the lock
+        ready[i].deleter(ready[i].ptr);
+}
+
+size_t EpochDomain::pending(){
+    lock_guard<mutex> guard(m_retiredLock);
+    return m_retired.size();
+}
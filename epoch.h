@@ -0,0 +1,62 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+using namespace std;
+const int CACHELINE = 64;       // keeps per-thread data of two threads off the same cache line
+const int MAXREADERS = 512;     // threads that can be inside the domain at the same time
+
+// epoch based reclamation: memory a writer unlinks is retired instead of deleted, and it is only
+// freed once every reader that might still hold a pointer to it has left the epoch it entered in.
+// Readers never lock, entering and leaving is one store to a cache line owned by the thread.
+class EpochDomain{
+public:
+    // the process wide domain, every thread gets a reader slot in it on first use
+    static EpochDomain& instance();
+    ~EpochDomain();
+    // a reader announces it may read shared pointers until exit()
+    void enter();
+    void exit();
+    // hands ptr to deleter once no reader can reach it, call it after ptr was unlinked
+    void retire(void* ptr, void (*deleter)(void*));
+    // frees everything no reader can reach anymore
+    void reclaim();
+    // number of retired pointers still waiting for readers
+    size_t pending();
+
+private:
+    struct alignas(CACHELINE) Reader{
+        atomic<uint64_t> epoch;     // 0 when the thread is outside, else the epoch it entered in
+        atomic<bool>     used;      // the slot belongs to a live thread
+    };
+    struct Retired{
+        void*    ptr;
+        void   (*deleter)(void*);
+        uint64_t epoch;             // global epoch when ptr was retired
+    };
+
+    Reader           m_readers[MAXREADERS];
+    atomic<uint64_t> m_epoch;       // global epoch, starts at 1
+    mutex            m_retiredLock; // writers only
+    vector<Retired>  m_retired;
+
+    EpochDomain();
+    // the reader slot of the calling thread
+    Reader& reader();
+    friend class ReaderHandle;
+};
+
+// enters the domain for the lifetime of the object
+class EpochGuard{
+public:
+    explicit EpochGuard(EpochDomain& domain) : m_domain(domain) {m_domain.enter();}
+    ~EpochGuard(){m_domain.exit();}
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+private:
+    EpochDomain& m_domain;
+};
+#endif
@@ -0,0 +1,192 @@
+#include "groupedvdetect.h"
+
+GroupedVDetect::GroupedVDetect(size_t size, hash_fn hash) : m_hash(hash), m_cursor(0), m_entries(0){
+    m_current = Table::allocate(pow2CapFor(size));
+    m_old = Table::none();
+}
+
+GroupedVDetect::~GroupedVDetect(){
+    m_current.release();
+    m_old.release();
+}
+
+float GroupedVDetect::lambda() const{
+    return m_current.load();
+}
+
+float GroupedVDetect::deletedRatio() const{
+    return m_current.deletedRatio();
+}
+
+bool GroupedVDetect::insert(const Virus& virus){
+    bool inserted = false;
+    int id = virus.getID();
+    if (id >= MINID && id <= MAXID) {
+        PackedKey packed(virus.getKey());
+        unsigned int hash = hashKey(virus.getKey(), packed);
+        Group* group = findGroup(packed, hash);
+        if (group == nullptr) { // first ID of the key, a new group in the current table
+            Group fresh{std::move(packed), hash, 0, {0}, NOOVERFLOW};
+            addId(fresh, uint16_t(id - MINID));
+            inserted = insertHelper(fresh);
+        } else if (!hasId(*group, uint16_t(id - MINID))) { // the group stays in the table it is in
+            addId(*group, uint16_t(id - MINID));
+            inserted = true;
+        }
+    }
+    m_entries += inserted;
+    rehashHelper();
+    return inserted;
+}
+
+bool GroupedVDetect::remove(const Virus& virus){
+    bool removed = false;
+    int id = virus.getID();
+    if (id >= MINID && id <= MAXID) {
+        PackedKey packed(virus.getKey());
+        unsigned int hash = hashKey(virus.getKey(), packed);
+        for (Table* table : {&m_current, &m_old}) {
+            Group* group = table->slots != nullptr ? findGroupIn(*table, packed, hash) : nullptr;
+            if (group == nullptr)
+                continue;
+            removed = dropId(*group, uint16_t(id - MINID));
+            if (removed && group->count == 0) { // the last ID took the key with it
+                size_t index = group - table->slots;
+                group->key = PackedKey();
+                setCtrl(table->ctrl, table->cap, index, CTRLDELETED);
+                table->numDeleted++;
+            }
+            break;
+        }
+    }
+    m_entries -= removed;
+    rehashHelper();
+    return removed;
+}
+
+Virus GroupedVDetect::getVirus(const string& key, int id) const{
+    if (contains(key, id))
+        return Virus(key, id);
+    return EMPTY;
+}
+
+bool GroupedVDetect::contains(string_view key, int id) const{
+    if (id < MINID || id > MAXID)
+        return false;
+    PackedKey packed(key);
+    Group* group = findGroup(packed, hashKey(key, packed));
+    return group != nullptr && hasId(*group, uint16_t(id - MINID));
+}
+
+vector<int> GroupedVDetect::findAll(string_view key) const{
+    vector<int> ids;
+    PackedKey packed(key);
+    Group* group = findGroup(packed, hashKey(key, packed));
+    if (group != nullptr) {
+        ids.reserve(group->count);
+        for (size_t i = 0; i < group->count; i++)
+            ids.push_back(MINID + idAt(*group, i));
+    }
+    return ids;
+}
+
+size_t GroupedVDetect::keyCount() const{
+    return m_current.live() + m_old.live();
+}
+
+unsigned int GroupedVDetect::hashKey(string_view key, const PackedKey& packed) const{
+    if (m_hash == packedHashCode)
+        return packed.hash();
+    return m_hash(string(key));
+}
+
+GroupedVDetect::Group* GroupedVDetect::findGroup(const PackedKey& key, unsigned int hash) const{
+    Group* group = findGroupIn(m_current, key, hash);
+    if (group == nullptr && m_old.slots != nullptr)
+        group = findGroupIn(m_old, key, hash);
+    return group;
+}
+
+GroupedVDetect::Group* GroupedVDetect::findGroupIn(const Table& table, const PackedKey& key, unsigned int hash) const{
+    size_t index = probeFind<GroupProbe, POW2CAP>(table.slots, table.ctrl, table.cap, hash,
+        [&](const Group& group) {return group.hash == hash && group.key == key;});
+    return index == NOSLOT ? nullptr : &table.slots[index];
+}
+
+uint16_t GroupedVDetect::idAt(const Group& group, size_t i) const{
+    return i < size_t(INLINEIDS) ? group.ids[i] : m_overflow[group.overflow][i - INLINEIDS];
+}
+
+bool GroupedVDetect::hasId(const Group& group, uint16_t id) const{
+    for (size_t i = 0; i < group.count; i++) {
+        if (idAt(group, i) == id)
+            return true;
+    }
+    return false;
+}
+
+void GroupedVDetect::addId(Group& group, uint16_t id){
+    if (group.count < INLINEIDS) {
+        group.ids[group.count++] = id;
+        return;
+    }
+    if (group.overflow == NOOVERFLOW) { // the first spill takes a free list or a new one
+        if (!m_freeOverflow.empty()) {
+            group.overflow = m_freeOverflow.back();
+            m_freeOverflow.pop_back();
+        } else {
+            group.overflow = m_overflow.size();
+            m_overflow.push_back(vector<uint16_t>());
+        }
+    }
+    m_overflow[group.overflow].push_back(id);
+    group.count++;
+}
+
+bool GroupedVDetect::dropId(Group& group, uint16_t id){
+    for (size_t i = 0; i < group.count; i++) {
+        if (idAt(group, i) != id)
+            continue;
+        uint16_t last = idAt(group, group.count - 1);
+        if (group.count > INLINEIDS) {
+            vector<uint16_t>& spilled = m_overflow[group.overflow];
+            spilled.pop_back();
+            if (spilled.empty()) { // back to inline only, the list is kept for the next spill
+                m_freeOverflow.push_back(group.overflow);
+                group.overflow = NOOVERFLOW;
+            }
+        }
+        group.count--;
+        if (i < group.count) { // the last ID fills the gap
+            if (i < size_t(INLINEIDS))
+                group.ids[i] = last;
+            else
+                m_overflow[group.overflow][i - INLINEIDS] = last;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool GroupedVDetect::insertHelper(Group& group){
+    size_t index = probeFree<GroupProbe, POW2CAP>(m_current.ctrl, m_current.cap, group.hash);
+    if (index == NOSLOT) // every group of the table is full, insert reports the key as not stored
+        return false;
+    setCtrl(m_current.ctrl, m_current.cap, index, hashFragment(group.hash));
+    m_current.slots[index] = std::move(group);
+    m_current.size++;
+    return true;
+}
+
+void GroupedVDetect::releaseGroup(const Group& group){
+    if (group.overflow != NOOVERFLOW) {
+        m_overflow[group.overflow].clear();
+        m_freeOverflow.push_back(group.overflow);
+    }
+}
+
+void GroupedVDetect::rehashHelper(){
+    // a group moves whole, its overflow list goes with it by index
+    rehashStep(m_current, m_old, m_cursor, [&](Group& group) {return insertHelper(group);},
+        [&](const Group& group) {m_entries -= group.count; releaseGroup(group);});
+}
@@ -0,0 +1,69 @@
+#ifndef GROUPEDVDETECT_H
+#define GROUPEDVDETECT_H
+#include "tablepair.h"
+const int INLINEIDS = 5;                    // IDs a group holds in its slot
+const uint32_t NOOVERFLOW = 0xFFFFFFFF;     // a group whose IDs all fit inline
+
+// VDetect that stores a key once with every ID it was inserted under, so one probe sequence
+// answers findAll(key) however many viruses share the key. The first INLINEIDS IDs sit in the
+// slot as offsets from MINID, more spill into an overflow list owned by the table. Capacities are
+// powers of two, probing is GroupProbe and the rehash rules are the ones of VDetect, counted in
+// keys (groups) instead of entries.
+class GroupedVDetect{
+public:
+    friend class Grader;
+    friend class Tester;
+    GroupedVDetect(size_t size, hash_fn hash);
+    ~GroupedVDetect();
+    GroupedVDetect(const GroupedVDetect&) = delete;
+    GroupedVDetect& operator=(const GroupedVDetect&) = delete;
+    // Returns Load factor of the new table
+    float lambda() const;
+    // Returns the ratio of deleted slots in the new table
+    float deletedRatio() const;
+    // false for an ID out of range, a duplicate and a new key the table has no free slot for
+    bool insert(const Virus& virus);
+    bool remove(const Virus& virus);
+    Virus getVirus(const string& key, int id) const;
+    bool contains(string_view key, int id) const;
+    // every ID stored with key, in insertion order until an ID is removed
+    vector<int> findAll(string_view key) const;
+    // number of key/ID entries
+    size_t size() const {return m_entries;}
+    // number of distinct keys
+    size_t keyCount() const;
+
+private:
+    struct Group{
+        PackedKey key;
+        unsigned int hash;          // hash_fn value of the key
+        uint16_t count;             // IDs in the group, 0 for EMPTY and DELETED slots
+        uint16_t ids[INLINEIDS];    // first IDs, minus MINID
+        uint32_t overflow;          // index in m_overflow of the IDs past INLINEIDS
+    };
+    typedef PairTable<Group> Table; // size and numDeleted count groups
+
+    hash_fn  m_hash;
+    Table    m_current;
+    Table    m_old;
+    size_t   m_cursor;      // first old slot that has not been migrated yet
+    size_t   m_entries;
+    vector<vector<uint16_t>> m_overflow;    // spilled IDs of the groups, shared by both tables
+    vector<uint32_t> m_freeOverflow;        // lists no group uses
+
+    unsigned int hashKey(string_view key, const PackedKey& packed) const;
+    // the group of key in either table or nullptr
+    Group* findGroup(const PackedKey& key, unsigned int hash) const;
+    Group* findGroupIn(const Table& table, const PackedKey& key, unsigned int hash) const;
+    uint16_t idAt(const Group& group, size_t i) const;
+    bool hasId(const Group& group, uint16_t id) const;
+    void addId(Group& group, uint16_t id);
+    // takes id out of the group, the last ID fills its place
+    bool dropId(Group& group, uint16_t id);
+    // moves group into the current table, false when no slot is free
+    bool insertHelper(Group& group);
+    // gives the overflow list of a group that is not stored back to the table
+    void releaseGroup(const Group& group);
+    void rehashHelper();
+};
+#endif
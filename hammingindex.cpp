@@ -0,0 +1,120 @@
+#include "hammingindex.h"
+
+const uint64_t LOWBITS = 0x5555555555555555ULL;    // the low bit of every 2-bit base
+
+// bases of one word that differ, a base differs when either of its two bits does
+static unsigned int wordMismatches(uint64_t lhs, uint64_t rhs){
+    uint64_t diff = lhs ^ rhs;
+    return __builtin_popcountll((diff | (diff >> 1)) & LOWBITS);
+}
+
+unsigned int hammingDistance(const PackedKey& lhs, const PackedKey& rhs){
+    unsigned int distance = 0;
+    for (unsigned int w = 0; w < lhs.wordCount(); w++)
+        distance += wordMismatches(lhs.words()[w], rhs.words()[w]);
+    return distance;
+}
+
+bool withinDistance(const PackedKey& lhs, const PackedKey& rhs, unsigned int limit){
+    unsigned int distance = 0;
+    for (unsigned int w = 0; w < lhs.wordCount() && distance <= limit; w++)
+        distance += wordMismatches(lhs.words()[w], rhs.words()[w]);
+    return distance <= limit;
+}
+
+// 2-bit code of base i of a DNA key
+static uint64_t baseAt(const PackedKey& key, unsigned int i){
+    unsigned int w = i / WORDBASES;
+    unsigned int inWord = w + 1 == key.wordCount() ? key.length() - w * WORDBASES : WORDBASES;
+    return (key.words()[w] >> ((inWord - 1 - i % WORDBASES) * BASEBITS)) & 3;
+}
+
+HammingIndex::HammingIndex(unsigned int k, unsigned int maxDistance) : m_k(k){
+    if (maxDistance > MAXDISTANCE)
+        maxDistance = MAXDISTANCE;
+    unsigned int segments = maxDistance + 1;
+    for (unsigned int s = 0; s <= segments; s++) // lengths differ by at most one base
+        m_starts.push_back(s * k / segments);
+    m_segments.resize(segments);
+}
+
+void HammingIndex::add(const PackedKey& key, int id){
+    if (!indexable(key))
+        return;
+    uint32_t entry = entryOf(key);
+    if (entry != NOENTRY) {
+        m_entries[entry].ids.push_back(id);
+        return;
+    }
+    if (!m_free.empty()) {
+        entry = m_free.back();
+        m_free.pop_back();
+        m_entries[entry].key = key;
+    } else {
+        entry = m_entries.size();
+        m_entries.push_back(Entry{key, vector<int>()});
+    }
+    m_entries[entry].ids.push_back(id);
+    m_byHash.emplace(key.hash(), entry);
+    for (size_t s = 0; s < m_segments.size(); s++)
+        m_segments[s][segmentValue(key, s)].push_back(entry);
+}
+
+void HammingIndex::remove(const PackedKey& key, int id){
+    if (!indexable(key))
+        return;
+    uint32_t entry = entryOf(key);
+    if (entry == NOENTRY)
+        return;
+    vector<int>& ids = m_entries[entry].ids;
+    auto found = find(ids.begin(), ids.end(), id);
+    if (found == ids.end())
+        return;
+    *found = ids.back();
+    ids.pop_back();
+    if (!ids.empty())
+        return;
+
+    // the last ID took the key with it
+    for (size_t s = 0; s < m_segments.size(); s++) {
+        auto bucket = m_segments[s].find(segmentValue(key, s));
+        vector<uint32_t>& list = bucket->second;
+        *find(list.begin(), list.end(), entry) = list.back();
+        list.pop_back();
+        if (list.empty())
+            m_segments[s].erase(bucket);
+    }
+    auto range = m_byHash.equal_range(key.hash());
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == entry) {
+            m_byHash.erase(it);
+            break;
+        }
+    }
+    m_entries[entry].key = PackedKey();
+    m_free.push_back(entry);
+}
+
+uint64_t HammingIndex::segmentValue(const PackedKey& key, size_t s) const{
+    uint64_t value = 0;
+    uint64_t folded = 0;
+    bool spilled = false;
+    for (unsigned int i = m_starts[s]; i < m_starts[s + 1]; i++) {
+        value = (value << BASEBITS) | baseAt(key, i);
+        if ((i - m_starts[s] + 1) % WORDBASES == 0 && i + 1 < m_starts[s + 1]) { // longer segments are hashed
+            folded = mix64(folded ^ value);
+            value = 0;
+            spilled = true;
+        }
+    }
+    return spilled ? mix64(folded ^ value) : value;
+}
+
+uint32_t HammingIndex::entryOf(const PackedKey& key) const{
+    auto range = m_byHash.equal_range(key.hash());
+    for (auto it = range.first; it != range.second; ++it) {
+        if (m_entries[it->second].key == key)
+            return it->second;
+    }
+    return NOENTRY;
+}
@@ -0,0 +1,69 @@
+#ifndef HAMMINGINDEX_H
+#define HAMMINGINDEX_H
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "packedkey.h"
+using namespace std;
+const int MAXDISTANCE = 4;  // most mismatches an index is built for
+const uint32_t NOENTRY = 0xFFFFFFFF;
+
+// number of bases two DNA keys of the same length differ in, a XOR and a popcount per word
+unsigned int hammingDistance(const PackedKey& lhs, const PackedKey& rhs);
+// the same, stopping once more than limit bases differ
+bool withinDistance(const PackedKey& lhs, const PackedKey& rhs, unsigned int limit);
+
+// pigeonhole index over the DNA keys of one length k: the key is cut into d + 1 segments, and a key
+// within d mismatches of a query must match it exactly in at least one of them. Each segment has a
+// hash map from its bases to the keys that have them, so a query reads d + 1 short lists and checks
+// only those candidates, instead of probing every one of the 3 * k * d neighbours.
+class HammingIndex{
+public:
+    friend class Grader;
+    friend class Tester;
+    HammingIndex(unsigned int k, unsigned int maxDistance);
+    unsigned int length() const {return m_k;}
+    unsigned int maxDistance() const {return m_segments.size() - 1;}
+    // keys of another length or with characters outside ALPHA are ignored
+    void add(const PackedKey& key, int id);
+    void remove(const PackedKey& key, int id);
+    // calls found with every stored key within distance of query and its IDs, distance at most maxDistance()
+    template <class Found>
+    void near(const PackedKey& query, unsigned int distance, Found found) const;
+
+private:
+    struct Entry{
+        PackedKey   key;
+        vector<int> ids;    // empty for a free entry
+    };
+    unsigned int m_k;
+    vector<unsigned int> m_starts;  // first base of every segment, m_k at the end
+    vector<Entry> m_entries;
+    vector<uint32_t> m_free;        // entries no key uses
+    unordered_multimap<unsigned int, uint32_t> m_byHash;   // key hash to entry
+    vector<unordered_map<uint64_t, vector<uint32_t>>> m_segments;
+
+    bool indexable(const PackedKey& key) const {return key.isDna() && key.length() == m_k;}
+    // the bases of segment s folded into one word, exact for segments of up to 32 bases
+    uint64_t segmentValue(const PackedKey& key, size_t s) const;
+    uint32_t entryOf(const PackedKey& key) const;
+};
+
+template <class Found>
+void HammingIndex::near(const PackedKey& query, unsigned int distance, Found found) const{
+    if (!indexable(query) || distance > maxDistance())
+        return;
+    vector<uint32_t> candidates;
+    for (size_t s = 0; s < m_segments.size(); s++) {
+        auto bucket = m_segments[s].find(segmentValue(query, s));
+        if (bucket != m_segments[s].end())
+            candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+    }
+    sort(candidates.begin(), candidates.end()); // a key sharing several segments is checked once
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+    for (uint32_t entry : candidates) {
+        if (withinDistance(m_entries[entry].key, query, distance))
+            found(m_entries[entry].key, m_entries[entry].ids);
+    }
+}
+#endif
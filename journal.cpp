@@ -0,0 +1,228 @@
+#include "journal.h"
+#include "vdetect.h"
+#include "mappedvdetect.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+
+const size_t RECORDHEAD = 10;   // op, kind, length and id in front of the key words
+const size_t RECORDTAIL = 4;    // checksum behind them
+
+unsigned int recordChecksum(const char* bytes, size_t length){
+    unsigned int sum = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        sum ^= (unsigned char)bytes[i];
+        sum *= 16777619u;
+    }
+    return sum;
+}
+
+long Journal::scanRecords(const vector<char>& bytes, size_t& end, VDetect* vdetect){
+    end = 0;
+    if (bytes.size() < sizeof(JOURNALMAGIC) || memcmp(bytes.data(), JOURNALMAGIC, sizeof(JOURNALMAGIC)) != 0)
+        return -1;
+    size_t pos = sizeof(JOURNALMAGIC);
+    long count = 0;
+    vector<uint64_t> words;
+    while (pos + RECORDHEAD <= bytes.size()) {
+        uint8_t op = bytes[pos];
+        uint8_t kind = bytes[pos + 1];
+        uint32_t length;
+        int32_t id;
+        memcpy(&length, &bytes[pos + 2], sizeof(length));
+        memcpy(&id, &bytes[pos + 6], sizeof(id));
+        if ((op != JOURNALINSERT && op != JOURNALREMOVE) || kind > RAWPACKED)
+            break;
+        size_t wordCount = PackedKey::wordsFor(length, pack_t(kind));
+        size_t size = RECORDHEAD + wordCount * sizeof(uint64_t) + RECORDTAIL;
+        if (size > bytes.size() - pos) // torn by a crash
+            break;
+        unsigned int checksum;
+        memcpy(&checksum, &bytes[pos + size - RECORDTAIL], sizeof(checksum));
+        if (checksum != recordChecksum(&bytes[pos], size - RECORDTAIL))
+            break;
+
+        if (vdetect != nullptr) {
+            words.resize(wordCount);
+            memcpy(words.data(), &bytes[pos + RECORDHEAD], wordCount * sizeof(uint64_t));
+            PackedKey key = PackedKey::fromWords(words.data(), length, pack_t(kind));
+            unsigned int hash = vdetect->m_hash == packedHashCode ? key.hash() : vdetect->m_hash(key.toString());
+            if (op == JOURNALINSERT)
+                vdetect->insertPacked(key, hash, id);
+            else
+                vdetect->removePacked(key, hash, id);
+        }
+        pos += size;
+        count++;
+    }
+    end = pos;
+    return count;
+}
+
+static bool readFile(const string& path, vector<char>& bytes){
+    ifstream in(path, ios::binary);
+    if (!in)
+        return false;
+    bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+Journal::Journal()
+    : m_fd(-1), m_logged(0), m_durable(0), m_failed(false), m_syncWanted(0),
+      m_interval(DEFSYNCINTERVAL), m_stop(false) {}
+
+Journal::~Journal(){
+    close();
+}
+
+bool Journal::open(const string& path, chrono::milliseconds interval){
+    close();
+    vector<char> bytes;
+    size_t end = 0;
+    if (readFile(path, bytes) && !bytes.empty() && scanRecords(bytes, end, nullptr) < 0)
+        return false; // something else lives at path
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+    // a torn record left by a crash is cut off, records appended behind it could never be replayed
+    bool ready = end == 0 ? (ftruncate(fd, 0) == 0 && writeAll(fd, JOURNALMAGIC, sizeof(JOURNALMAGIC)))
+                          : ftruncate(fd, end) == 0;
+    ready = ready && lseek(fd, 0, SEEK_END) >= 0 && fdatasync(fd) == 0;
+    if (!ready) {
+        ::close(fd);
+        return false;
+    }
+    m_fd = fd;
+    m_buffer.clear();
+    m_logged = 0;
+    m_durable = 0;
+    m_failed = false;
+    m_interval = interval;
+    m_stop = false;
+    m_writer = thread(&Journal::writerLoop, this);
+    return true;
+}
+
+void Journal::close(){
+    if (m_fd < 0)
+        return;
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_writer.join(); // the writer drains the buffer before it returns
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+void Journal::logInsert(const PackedKey& key, int id){
+    append(JOURNALINSERT, key, id);
+}
+
+void Journal::logRemove(const PackedKey& key, int id){
+    append(JOURNALREMOVE, key, id);
+}
+
+void Journal::append(journalop_t op, const PackedKey& key, int id){
+    size_t wordBytes = key.wordCount() * sizeof(uint64_t);
+    size_t size = RECORDHEAD + wordBytes + RECORDTAIL;
+    uint8_t head[2] = {uint8_t(op), uint8_t(key.isDna() ? DNAPACKED : RAWPACKED)};
+    uint32_t length = key.length();
+    int32_t id32 = id;
+
+    lock_guard<mutex> guard(m_lock);
+    if (m_fd < 0) // a closed journal logs nothing
+        return;
+    size_t pos = m_buffer.size();
+    m_buffer.resize(pos + size); // grows geometrically, no allocation for most records
+    char* record = &m_buffer[pos];
+    memcpy(record, head, sizeof(head));
+    memcpy(record + 2, &length, sizeof(length));
+    memcpy(record + 6, &id32, sizeof(id32));
+    memcpy(record + RECORDHEAD, key.words(), wordBytes);
+    unsigned int checksum = recordChecksum(record, size - RECORDTAIL);
+    memcpy(record + size - RECORDTAIL, &checksum, sizeof(checksum));
+    m_logged += size;
+    if (m_buffer.size() >= JOURNALFLUSH)
+        m_wake.notify_one();
+}
+
+bool Journal::sync(){
+    unique_lock<mutex> guard(m_lock);
+    if (m_fd < 0)
+        return false;
+    uint64_t target = m_logged;
+    m_syncWanted++;
+    m_wake.notify_one();
+    m_synced.wait(guard, [&]() {return m_durable >= target || m_failed;});
+    m_syncWanted--;
+    return !m_failed;
+}
+
+bool Journal::truncate(){
+    unique_lock<mutex> guard(m_lock);
+    if (m_fd < 0)
+        return false;
+    lock_guard<mutex> file(m_fileLock); // waits out a write that is under way
+    m_buffer.clear();
+    bool done = ftruncate(m_fd, 0) == 0 && lseek(m_fd, 0, SEEK_SET) == 0 &&
+                writeAll(m_fd, JOURNALMAGIC, sizeof(JOURNALMAGIC)) && fdatasync(m_fd) == 0;
+    m_durable = m_logged; // nothing logged so far needs the file anymore
+    m_failed = m_failed || !done;
+    m_synced.notify_all();
+    return done;
+}
+
+bool Journal::checkpoint(VDetect& vdetect, const string& snapshot){
+    if (!sync())
+        return false;
+    // the table lock is held from the save to the truncate, so no operation is logged in between
+    // and lost; the log is only emptied once the snapshot is renamed into place and fsynced
+    vdetect.waitForRehash();
+    unique_lock<mutex> guard = vdetect.lockTables();
+    return MappedVDetect::write(vdetect, snapshot) && truncate();
+}
+
+long Journal::replay(const string& path, VDetect& vdetect){
+    vector<char> bytes;
+    if (!readFile(path, bytes))
+        return -1;
+    unique_lock<mutex> guard = vdetect.lockTables();
+    Journal* attached = vdetect.m_journal; // replayed records are not logged again
+    vdetect.m_journal = nullptr;
+    size_t end;
+    long count = scanRecords(bytes, end, &vdetect);
+    vdetect.m_journal = attached;
+    return count;
+}
+
+void Journal::writerLoop(){
+    unique_lock<mutex> guard(m_lock);
+    while (true) {
+        m_wake.wait_for(guard, m_interval, [this]() {
+            return m_stop || m_buffer.size() >= JOURNALFLUSH || (m_syncWanted > 0 && !m_buffer.empty());
+        });
+        if (m_buffer.empty()) {
+            if (m_stop)
+                break;
+            continue;
+        }
+        // the buffer is swapped out so operations keep appending while the fsync runs
+        vector<char> out;
+        out.swap(m_buffer);
+        m_buffer.reserve(out.capacity());
+        uint64_t target = m_logged;
+        unique_lock<mutex> file(m_fileLock);
+        guard.unlock();
+        bool written = writeAll(m_fd, out.data(), out.size()) && fdatasync(m_fd) == 0;
+        file.unlock();
+        guard.lock();
+        if (written && target > m_durable)
+            m_durable = target;
+        m_failed = m_failed || !written;
+        m_synced.notify_all();
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "packedkey.h"
+using namespace std;
+class VDetect; // forward declaration
+const char JOURNALMAGIC[8] = {'V', 'D', 'J', 'O', 'U', 'R', 'N', '\0'};
+const chrono::milliseconds DEFSYNCINTERVAL(10); // most time a logged operation waits to reach the disk
+const size_t JOURNALFLUSH = 1 << 20;            // buffered bytes that wake the writer before the interval
+
+enum journalop_t {JOURNALINSERT = 1, JOURNALREMOVE = 2};
+
+// append-only write-ahead log of the inserts and removes of a VDetect. Records carry the packed key
+// (2 bits per base for DNA), so a 40-base insert is 30 bytes on disk. Operations only append to a
+// buffer; a writer thread hands the buffer to the file and fsyncs once per interval, so every
+// operation of that interval shares one fsync (group commit) and a crash loses at most one interval.
+// Record: op (1 byte), kind (1), length (4), id (4), key words (8 each), checksum (4).
+class Journal{
+public:
+    friend class Grader;
+    friend class Tester;
+    Journal();
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    // opens path for appending, creating it when it does not exist, and starts the writer thread
+    bool open(const string& path, chrono::milliseconds interval = DEFSYNCINTERVAL);
+    // writes and fsyncs everything buffered, then stops the writer
+    void close();
+    bool isOpen() const {return m_fd >= 0;}
+    void logInsert(const PackedKey& key, int id);
+    void logRemove(const PackedKey& key, int id);
+    // returns once every operation logged before the call is on disk; callers that sync at the
+    // same time share the fsync. False once a write to the file failed
+    bool sync();
+    // empties the log, for use right after a snapshot of the table was saved
+    bool truncate();
+    // saves vdetect to snapshot and empties the log once the snapshot is durable; with background
+    // rehash on, writers wait for the checkpoint, otherwise no operation may run on vdetect meanwhile
+    bool checkpoint(VDetect& vdetect, const string& snapshot);
+    // applies every complete record of the log at path to vdetect without logging them again;
+    // a torn record at the end (a crash during a write) ends the replay. Returns the number of
+    // records applied or -1 if path is not a journal
+    static long replay(const string& path, VDetect& vdetect);
+
+private:
+    int                     m_fd;           // -1 when closed
+    vector<char>            m_buffer;       // records not handed to the file yet
+    uint64_t                m_logged;       // bytes logged since open
+    uint64_t                m_durable;      // bytes logged since open that are on disk
+    bool                    m_failed;       // a write or fsync failed, sync reports it
+    int                     m_syncWanted;   // callers waiting in sync, they wake the writer early
+    chrono::milliseconds    m_interval;
+    bool                    m_stop;
+    thread                  m_writer;
+    mutex                   m_lock;         // guards everything above
+    mutex                   m_fileLock;     // held while the file is written, taken after m_lock
+    condition_variable      m_wake;         // wakes the writer early
+    condition_variable      m_synced;       // signals a finished fsync
+
+    void append(journalop_t op, const PackedKey& key, int id);
+    void writerLoop();
+    // walks the records of a journal read into bytes, applying each one to vdetect when it is not
+    // nullptr; end is set past the last complete record. Returns the number of records, -1 without a header
+    static long scanRecords(const vector<char>& bytes, size_t& end, VDetect* vdetect);
+};
+
+// checksum of a record, FNV-1a over its bytes
+unsigned int recordChecksum(const char* bytes, size_t length);
+#endif
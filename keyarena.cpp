@@ -0,0 +1,39 @@
+#include "keyarena.h"
+#include <cstring>
+
+KeyArena::KeyArena() : m_free(0), m_wordsUsed(0), m_wordsReserved(0) {}
+
+KeyArena::~KeyArena(){
+    for (size_t i = 0; i < m_chunks.size(); i++)
+        delete [] m_chunks[i];
+}
+
+PackedKey KeyArena::store(const PackedKey& key){
+    if (key.isInline())
+        return key;
+
+    size_t count = key.wordCount();
+    uint64_t* dest;
+    if (count > ARENACHUNK) { // a key longer than a chunk gets a chunk of its own
+        dest = new uint64_t[count];
+        m_chunks.insert(m_chunks.end() - (m_chunks.empty() ? 0 : 1), dest); // the last chunk stays last
+        m_wordsReserved += count;
+    } else {
+        if (m_free < count) {
+            m_chunks.push_back(new uint64_t[ARENACHUNK]);
+            m_free = ARENACHUNK;
+            m_wordsReserved += ARENACHUNK;
+        }
+        dest = m_chunks.back() + (ARENACHUNK - m_free);
+        m_free -= count;
+    }
+    memcpy(dest, key.words(), count * sizeof(uint64_t));
+    m_wordsUsed += count;
+
+    PackedKey borrowed;
+    borrowed.m_words = dest;
+    borrowed.m_length = key.m_length;
+    borrowed.m_kind = key.m_kind;
+    borrowed.m_borrowed = true;
+    return borrowed;
+}
@@ -0,0 +1,36 @@
+#ifndef KEYARENA_H
+#define KEYARENA_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "packedkey.h"
+using namespace std;
+const size_t ARENACHUNK = 8192;    // words of one arena chunk (64 KiB)
+
+// append-only storage for the words of keys longer than one word. Every table of VDetect has one,
+// its slots borrow their words from it, so a table with millions of long keys makes a few chunk
+// allocations instead of one per key, and freeing the table frees the chunks and nothing else.
+// Chunks never move, a borrowed key stays valid until the arena is deleted.
+class KeyArena{
+public:
+    friend class Grader;
+    friend class Tester;
+    KeyArena();
+    ~KeyArena();
+    KeyArena(const KeyArena&) = delete;
+    KeyArena& operator=(const KeyArena&) = delete;
+    // copies the words of key into the arena, the returned key borrows them;
+    // an inline key is returned as it is
+    PackedKey store(const PackedKey& key);
+    // words handed out so far, removed keys included
+    size_t wordsUsed() const {return m_wordsUsed;}
+    // words allocated for the chunks
+    size_t wordsReserved() const {return m_wordsReserved;}
+
+private:
+    vector<uint64_t*> m_chunks;
+    size_t m_free;          // unused words at the end of the last chunk
+    size_t m_wordsUsed;
+    size_t m_wordsReserved;
+};
+#endif
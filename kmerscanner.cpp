@@ -0,0 +1,153 @@
+#include "kmerscanner.h"
+#include <fstream>
+
+KmerScanner::KmerScanner(const VDetect& vdetect, unsigned int k, size_t chunk)
+    : m_vdetect(vdetect), m_k(k), m_chunk(chunk > 0 ? chunk : SCANCHUNK), m_window(string(k, 'A')),
+      m_valid(0), m_state(LINESTART), m_fastq(false), m_read(0), m_position(0), m_quality(0), m_open(false),
+      m_reads(0), m_bases(0), m_hits(0){
+    m_count = m_window.wordCount();
+    m_words = m_count <= 1 ? &m_window.m_word : m_window.m_words;
+    unsigned int lastBases = k - (m_count > 0 ? (m_count - 1) * WORDBASES : 0);
+    m_lastMask = lastBases >= WORDBASES ? ~uint64_t(0) : (uint64_t(1) << (lastBases * BASEBITS)) - 1;
+    m_lastShift = lastBases > 0 ? (lastBases - 1) * BASEBITS : 0;
+}
+
+bool KmerScanner::scanFile(const string& path, const hit_fn& onHit){
+    if (path == "-")
+        return scanStream(cin, onHit);
+    ifstream in(path, ios::binary);
+    if (!in)
+        return false;
+    return scanStream(in, onHit);
+}
+
+bool KmerScanner::scanStream(istream& in, const hit_fn& onHit){
+    m_state = LINESTART;
+    m_fastq = false;
+    vector<char> buffer(m_chunk);
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        consume(buffer.data(), in.gcount(), onHit);
+    }
+    finishRead();
+    return !in.bad();
+}
+
+void KmerScanner::scanBuffer(string_view text, const hit_fn& onHit){
+    m_state = LINESTART;
+    m_fastq = false;
+    consume(text.data(), text.size(), onHit);
+    finishRead();
+}
+
+void KmerScanner::reset(){
+    m_state = LINESTART;
+    m_fastq = false;
+    m_open = false;
+    m_reads = 0;
+    m_bases = 0;
+    m_hits = 0;
+}
+
+size_t KmerScanner::scanSequence(string_view sequence, size_t read, const hit_fn& onHit){
+    unique_lock<mutex> guard = m_vdetect.lockTables();
+    size_t before = m_hits;
+    startRead();
+    m_read = read;
+    for (char base : sequence)
+        push(base, onHit);
+    finishRead();
+    return m_hits - before;
+}
+
+void KmerScanner::startRead(){
+    finishRead();
+    m_read = m_reads++;
+    m_name.clear();
+    m_position = 0;
+    m_valid = 0;
+    m_open = true;
+}
+
+void KmerScanner::finishRead(){
+    if (m_open && m_onRead)
+        m_onRead(m_read, m_name, m_position);
+    m_open = false;
+}
+
+void KmerScanner::push(char base, const hit_fn& onHit){
+    if (base >= 'a' && base <= 'z') // soft-masked bases are still bases
+        base -= 'a' - 'A';
+    int code = baseCode(base);
+    m_position++;
+    m_bases++;
+    if (code < 0 || m_count == 0) {
+        m_valid = 0;
+        return;
+    }
+
+    // shift the whole window one base towards the first word, the top base of each word moves
+    // into the bottom of the one before it
+    for (unsigned int w = 0; w + 1 < m_count; w++) {
+        uint64_t carry = w + 2 == m_count ? (m_words[w + 1] >> m_lastShift) & 3 : m_words[w + 1] >> (64 - BASEBITS);
+        m_words[w] = (m_words[w] << BASEBITS) | carry;
+    }
+    m_words[m_count - 1] = ((m_words[m_count - 1] << BASEBITS) | uint64_t(code)) & m_lastMask;
+    if (++m_valid < m_k)
+        return;
+
+    unsigned int hash = m_vdetect.m_hash == packedHashCode ? packedWordsHash(m_words, m_count, m_k, DNAPACKED)
+                                                           : m_vdetect.m_hash(m_window.toString());
+    const Slot* slot = m_vdetect.findKeySlot(m_window, hash);
+    if (slot != nullptr) {
+        m_hits++;
+        onHit(KmerHit{m_read, m_position - m_k, slot->getID()});
+    }
+}
+
+void KmerScanner::consume(const char* bytes, size_t length, const hit_fn& onHit){
+    unique_lock<mutex> guard = m_vdetect.lockTables(); // once per chunk, not per window
+    for (size_t i = 0; i < length; i++) {
+        char c = bytes[i];
+        switch (m_state) {
+            case LINESTART:
+                if (c == '\n' || c == '\r')
+                    break;
+                if (c == '>' || c == '@') { // a quality line never gets here, QUALITY counts its characters
+                    m_fastq = c == '@';
+                    startRead();
+                    m_state = HEADER;
+                } else if (c == '+' && m_fastq) {
+                    m_state = PLUS;
+                } else {
+                    if (!m_open) // bare sequence without a header
+                        startRead();
+                    m_state = SEQUENCE;
+                    push(c, onHit);
+                }
+                break;
+            case HEADER:
+                if (c == '\n')
+                    m_state = LINESTART;
+                else if (c != '\r')
+                    m_name += c;
+                break;
+            case SEQUENCE: // a window runs on across the lines of a multi-line record
+                if (c == '\n')
+                    m_state = LINESTART;
+                else if (c != '\r')
+                    push(c, onHit);
+                break;
+            case PLUS:
+                if (c == '\n') {
+                    m_quality = m_position;
+                    m_state = m_quality > 0 ? QUALITY : LINESTART;
+                }
+                break;
+            case QUALITY:
+                if (c != '\n' && c != '\r' && --m_quality == 0)
+                    m_state = LINESTART;
+                break;
+        }
+    }
+}
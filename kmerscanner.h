@@ -0,0 +1,82 @@
+#ifndef KMERSCANNER_H
+#define KMERSCANNER_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <istream>
+#include <functional>
+#include "vdetect.h"
+using namespace std;
+const size_t SCANCHUNK = 1 << 20;   // bytes read from the input at a time
+
+// a k-mer window of a read that is stored in the table
+struct KmerHit{
+    size_t read;        // index of the read in the input, from 0
+    size_t position;    // offset of the window's first base in the read
+    int    id;          // ID of one entry with that key
+};
+
+// streams FASTA or FASTQ (told apart by the first character) through a VDetect, probing every
+// window of k bases. The window is kept packed like PackedKey and rolled one base at a time, so a
+// window costs a shift per key word and one packedWordsHash, never a string; a table with a custom
+// hash_fn still works but pays for a string per window. Lower case bases count as upper case, any
+// other character in a sequence (N, IUPAC codes) restarts the window after it.
+class KmerScanner{
+public:
+    friend class Grader;
+    friend class Tester;
+    typedef function<void(const KmerHit&)> hit_fn;
+    // called when a read is complete with its index, name and number of bases
+    typedef function<void(size_t, const string&, size_t)> read_fn;
+    KmerScanner(const VDetect& vdetect, unsigned int k, size_t chunk = SCANCHUNK);
+    KmerScanner(const KmerScanner&) = delete; // m_words points into m_window
+    KmerScanner& operator=(const KmerScanner&) = delete;
+    // scans the file at path, "-" for stdin; false if it cannot be read
+    bool scanFile(const string& path, const hit_fn& onHit);
+    bool scanStream(istream& in, const hit_fn& onHit);
+    // scans one sequence as read number read, returns the number of hits
+    size_t scanSequence(string_view sequence, size_t read, const hit_fn& onHit);
+    // scans text holding whole records, reads are numbered on from the last scan
+    void scanBuffer(string_view text, const hit_fn& onHit);
+    // forgets the reads and counters of earlier scans
+    void reset();
+    void setReadCallback(const read_fn& onRead) {m_onRead = onRead;}
+    // name of the read a hit is reported for, header line without '>' or '@'
+    const string& readName() const {return m_name;}
+    size_t reads() const {return m_reads;}
+    size_t bases() const {return m_bases;}
+    size_t hits() const {return m_hits;}
+
+private:
+    enum state_t {LINESTART, HEADER, SEQUENCE, PLUS, QUALITY};
+
+    const VDetect& m_vdetect;
+    unsigned int   m_k;
+    size_t         m_chunk;
+    PackedKey      m_window;    // the last k bases, packed in place
+    uint64_t*      m_words;     // m_window's words
+    unsigned int   m_count;     // number of words of m_window
+    uint64_t       m_lastMask;  // bits used in the last word
+    unsigned int   m_lastShift; // position of the first base of the last word
+    size_t         m_valid;     // bases rolled in since the window was last restarted
+
+    state_t        m_state;
+    bool           m_fastq;
+    string         m_name;
+    size_t         m_read;      // index of the read being scanned, m_reads - 1
+    size_t         m_position;  // bases of the current read seen so far
+    size_t         m_quality;   // quality characters still to skip
+    bool           m_open;      // a read was started and not reported to m_onRead yet
+    read_fn        m_onRead;
+
+    size_t         m_reads;
+    size_t         m_bases;
+    size_t         m_hits;
+
+    void startRead();
+    void finishRead();
+    // feeds one sequence character, probes when the window is full
+    void push(char base, const hit_fn& onHit);
+    void consume(const char* bytes, size_t length, const hit_fn& onHit);
+};
+#endif
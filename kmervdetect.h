@@ -0,0 +1,217 @@
+#ifndef KMERVDETECT_H
+#define KMERVDETECT_H
+#include "tablepair.h"
+
+// a DNA key of exactly K bases, packed like PackedKey (32 bases per word, first base in the highest
+// bits), so its hash is the packedHashCode of the same string
+template <int K>
+struct Kmer{
+    static const int WORDS = (K + WORDBASES - 1) / WORDBASES;
+    uint64_t words[WORDS];
+
+    // packs key, false when it is not K bases out of ALPHA
+    bool pack(string_view key){
+        if (key.length() != size_t(K))
+            return false;
+        for (int w = 0; w < WORDS; w++) {
+            uint64_t word = 0;
+            int end = (w + 1) * WORDBASES < K ? (w + 1) * WORDBASES : K;
+            for (int i = w * WORDBASES; i < end; i++) {
+                int code = baseCode(key[i]);
+                if (code < 0)
+                    return false;
+                word = (word << BASEBITS) | uint64_t(code);
+            }
+            words[w] = word;
+        }
+        return true;
+    }
+    string toString() const {
+        string key(K, ' ');
+        for (int i = 0; i < K; i++) {
+            int w = i / WORDBASES;
+            int last = (w + 1) * WORDBASES < K ? (w + 1) * WORDBASES : K;
+            key[i] = ALPHA[(words[w] >> ((last - 1 - i) * BASEBITS)) & 3];
+        }
+        return key;
+    }
+    unsigned int hash() const {return packedWordsHash(words, WORDS, K, DNAPACKED);}
+    bool operator==(const Kmer& rhs) const {
+        bool same = true;
+        for (int w = 0; w < WORDS; w++) // no early exit, the compiler turns this into a few compares
+            same &= words[w] == rhs.words[w];
+        return same;
+    }
+};
+
+// VDetect for keys that all have K bases. Entries hold the packed k-mer inline, there is no length,
+// no kind and no heap words, so a slot of a k <= 32 table is 16 bytes and every compare and hash
+// is a fixed number of word operations. Capacities are powers of two and the probing policy is
+// fixed at compile time like StaticVDetect; the rehash rules are the ones of VDetect.
+template <int K, class Probe = GroupProbe>
+class KmerVDetect{
+public:
+    friend class Grader;
+    friend class Tester;
+    explicit KmerVDetect(size_t size);
+    ~KmerVDetect();
+    // Returns Load factor of the new table
+    float lambda() const;
+    // Returns the ratio of deleted slots in the new table
+    float deletedRatio() const;
+    // a key that is not K bases of ACGT is never stored; insert is false for it, for a duplicate
+    // and for a k-mer whose probe sequence is full
+    bool insert(const Virus& virus);
+    bool remove(const Virus& virus);
+    Virus getVirus(const string& key, int id) const;
+    bool contains(string_view key, int id) const;
+    // the same for keys that are already packed
+    bool insert(const Kmer<K>& kmer, int id);
+    bool remove(const Kmer<K>& kmer, int id);
+    bool contains(const Kmer<K>& kmer, int id) const;
+    // number of live entries in both tables
+    size_t size() const;
+
+private:
+    struct Entry{
+        Kmer<K> kmer;
+        int     id;         // 0 for EMPTY and DELETED entries
+    };
+    typedef PairTable<Entry> Table;
+
+    Table  m_current;
+    Table  m_old;
+    size_t m_cursor;        // first old slot that has not been migrated yet
+
+    size_t findIndex(const Table& table, const Kmer<K>& kmer, unsigned int hash, int id) const;
+    // false when the probe sequence of hash is full
+    bool insertHelper(const Entry& entry, unsigned int hash);
+    void rehashHelper();
+    bool eraseFrom(Table& table, const Kmer<K>& kmer, unsigned int hash, int id);
+};
+
+template <int K, class Probe>
+KmerVDetect<K, Probe>::KmerVDetect(size_t size){
+    m_current = Table::allocate(pow2CapFor(size));
+    m_old = Table::none();
+    m_cursor = 0;
+}
+
+template <int K, class Probe>
+KmerVDetect<K, Probe>::~KmerVDetect(){
+    m_current.release();
+    m_old.release();
+}
+
+template <int K, class Probe>
+float KmerVDetect<K, Probe>::lambda() const{
+    return m_current.load();
+}
+
+template <int K, class Probe>
+float KmerVDetect<K, Probe>::deletedRatio() const{
+    return m_current.deletedRatio();
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::insert(const Virus& virus){
+    Kmer<K> kmer;
+    if (!kmer.pack(virus.getKey())) {
+        rehashHelper();
+        return false;
+    }
+    return insert(kmer, virus.getID());
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::remove(const Virus& virus){
+    Kmer<K> kmer;
+    if (!kmer.pack(virus.getKey())) {
+        rehashHelper();
+        return false;
+    }
+    return remove(kmer, virus.getID());
+}
+
+template <int K, class Probe>
+Virus KmerVDetect<K, Probe>::getVirus(const string& key, int id) const{
+    if (contains(string_view(key), id))
+        return Virus(key, id);
+    return EMPTY;
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::contains(string_view key, int id) const{
+    Kmer<K> kmer;
+    return kmer.pack(key) && contains(kmer, id);
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::insert(const Kmer<K>& kmer, int id){
+    bool inserted = false;
+    if (id >= MINID && id <= MAXID && !contains(kmer, id)) {
+        unsigned int hash = kmer.hash();
+        migrateHash<Probe>(m_current, m_old, m_cursor, hash, [](const Entry& entry) {return entry.kmer.hash();},
+            [&](const Entry& entry) {return insertHelper(entry, entry.kmer.hash());}, [](const Entry&) {});
+        inserted = insertHelper(Entry{kmer, id}, hash);
+    }
+    rehashHelper();
+    return inserted;
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::remove(const Kmer<K>& kmer, int id){
+    unsigned int hash = kmer.hash();
+    bool removed = eraseFrom(m_current, kmer, hash, id) ||
+                   (m_old.slots != nullptr && eraseFrom(m_old, kmer, hash, id));
+    rehashHelper();
+    return removed;
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::contains(const Kmer<K>& kmer, int id) const{
+    unsigned int hash = kmer.hash();
+    return findIndex(m_current, kmer, hash, id) != NOSLOT ||
+           (m_old.slots != nullptr && findIndex(m_old, kmer, hash, id) != NOSLOT);
+}
+
+template <int K, class Probe>
+size_t KmerVDetect<K, Probe>::size() const{
+    return m_current.live() + m_old.live();
+}
+
+template <int K, class Probe>
+size_t KmerVDetect<K, Probe>::findIndex(const Table& table, const Kmer<K>& kmer, unsigned int hash, int id) const{
+    return probeFind<Probe, POW2CAP>(table.slots, table.ctrl, table.cap, hash,
+        [&](const Entry& entry) {return entry.id == id && entry.kmer == kmer;});
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::insertHelper(const Entry& entry, unsigned int hash){
+    size_t index = probeFree<Probe, POW2CAP>(m_current.ctrl, m_current.cap, hash);
+    if (index == NOSLOT) // there is no stash, insert reports the k-mer as not stored
+        return false;
+    m_current.slots[index] = entry;
+    setCtrl(m_current.ctrl, m_current.cap, index, hashFragment(hash));
+    m_current.size++;
+    return true;
+}
+
+template <int K, class Probe>
+bool KmerVDetect<K, Probe>::eraseFrom(Table& table, const Kmer<K>& kmer, unsigned int hash, int id){
+    size_t index = findIndex(table, kmer, hash, id);
+    if (index == NOSLOT)
+        return false;
+    table.slots[index].id = 0;
+    setCtrl(table.ctrl, table.cap, index, CTRLDELETED);
+    table.numDeleted++;
+    return true;
+}
+
+template <int K, class Probe>
+void KmerVDetect<K, Probe>::rehashHelper(){
+    // the hash is recomputed from the k-mer, which is cheaper than storing it in every slot
+    rehashStep(m_current, m_old, m_cursor,
+        [&](const Entry& entry) {return insertHelper(entry, entry.kmer.hash());}, [](const Entry&) {});
+}
+#endif
@@ -1,6 +1,19 @@
 #include "vdetect.h"
+#include "staticvdetect.h"
+#include "concurrentvdetect.h"
+#include "kmervdetect.h"
+#include "mappedvdetect.h"
+#include "journal.h"
+#include "kmerscanner.h"
+#include "readpipeline.h"
+#include "groupedvdetect.h"
 #include <random>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 enum RANDOM {UNIFORMINT, UNIFORMREAL, NORMAL};
 class Random {
 public:
@@ -86,11 +99,41 @@ public:
     bool testRehashLoadFactor();
     bool testRehashRemoval();
     bool testRehashDeleteRatio();
+    bool testPackedKeys();
+    bool testSwissTableProbing();
+    bool testCachedHash();
+    bool testLargeCapacities();
+    bool testStaticVDetect();
+    bool testConcurrentVDetect();
+    bool testLockFreeReaders();
+    bool testBatchOperations();
+    bool testBackgroundRehash();
+    bool testMigrationBudget();
+    bool testRobinHoodProbing();
+    bool testCuckooHashing();
+    bool testStringViewLookup();
+    bool testKeyArena();
+    bool testKmerVDetect();
+    bool testMappedSnapshot();
+    bool testJournal();
+    bool testKmerScanner();
+    bool testReadPipeline();
+    bool testPrefilter();
+    bool testIdIndex();
+    bool testFindAll();
+    bool testHammingLookup();
+    bool testLiveIteration();
+    bool testOperationStats();
+    bool testStashOverflow();
+    bool testPrefilterChurn();
 
 };
 
 unsigned int hashCode(const string str);
+unsigned int countingHashCode(const string str);
+unsigned int constantHashCode(const string str);
 string sequencer(int size, int seedNum);
+int hashCalls = 0;  // number of countingHashCode calls
 
 int main(){
     Tester tester;
@@ -145,6 +188,141 @@ int main(){
     else
         cout << "\ttestRehashDeleteRatio() returned false." << endl;
 
+    if (tester.testPackedKeys()) // should return true
+        cout << "\ttestPackedKeys() returned true." << endl;
+    else
+        cout << "\ttestPackedKeys() returned false." << endl;
+
+    if (tester.testSwissTableProbing()) // should return true
+        cout << "\ttestSwissTableProbing() returned true." << endl;
+    else
+        cout << "\ttestSwissTableProbing() returned false." << endl;
+
+    if (tester.testCachedHash()) // should return true
+        cout << "\ttestCachedHash() returned true." << endl;
+    else
+        cout << "\ttestCachedHash() returned false." << endl;
+
+    if (tester.testLargeCapacities()) // should return true
+        cout << "\ttestLargeCapacities() returned true." << endl;
+    else
+        cout << "\ttestLargeCapacities() returned false." << endl;
+
+    if (tester.testStaticVDetect()) // should return true
+        cout << "\ttestStaticVDetect() returned true." << endl;
+    else
+        cout << "\ttestStaticVDetect() returned false." << endl;
+
+    if (tester.testConcurrentVDetect()) // should return true
+        cout << "\ttestConcurrentVDetect() returned true." << endl;
+    else
+        cout << "\ttestConcurrentVDetect() returned false." << endl;
+
+    if (tester.testLockFreeReaders()) // should return true
+        cout << "\ttestLockFreeReaders() returned true." << endl;
+    else
+        cout << "\ttestLockFreeReaders() returned false." << endl;
+
+    if (tester.testBatchOperations()) // should return true
+        cout << "\ttestBatchOperations() returned true." << endl;
+    else
+        cout << "\ttestBatchOperations() returned false." << endl;
+
+    if (tester.testBackgroundRehash()) // should return true
+        cout << "\ttestBackgroundRehash() returned true." << endl;
+    else
+        cout << "\ttestBackgroundRehash() returned false." << endl;
+
+    if (tester.testMigrationBudget()) // should return true
+        cout << "\ttestMigrationBudget() returned true." << endl;
+    else
+        cout << "\ttestMigrationBudget() returned false." << endl;
+
+    if (tester.testRobinHoodProbing()) // should return true
+        cout << "\ttestRobinHoodProbing() returned true." << endl;
+    else
+        cout << "\ttestRobinHoodProbing() returned false." << endl;
+
+    if (tester.testCuckooHashing()) // should return true
+        cout << "\ttestCuckooHashing() returned true." << endl;
+    else
+        cout << "\ttestCuckooHashing() returned false." << endl;
+
+    if (tester.testStringViewLookup()) // should return true
+        cout << "\ttestStringViewLookup() returned true." << endl;
+    else
+        cout << "\ttestStringViewLookup() returned false." << endl;
+
+    if (tester.testKeyArena()) // should return true
+        cout << "\ttestKeyArena() returned true." << endl;
+    else
+        cout << "\ttestKeyArena() returned false." << endl;
+
+    if (tester.testKmerVDetect()) // should return true
+        cout << "\ttestKmerVDetect() returned true." << endl;
+    else
+        cout << "\ttestKmerVDetect() returned false." << endl;
+
+    if (tester.testMappedSnapshot()) // should return true
+        cout << "\ttestMappedSnapshot() returned true." << endl;
+    else
+        cout << "\ttestMappedSnapshot() returned false." << endl;
+
+    if (tester.testJournal()) // should return true
+        cout << "\ttestJournal() returned true." << endl;
+    else
+        cout << "\ttestJournal() returned false." << endl;
+
+    if (tester.testKmerScanner()) // should return true
+        cout << "\ttestKmerScanner() returned true." << endl;
+    else
+        cout << "\ttestKmerScanner() returned false." << endl;
+
+    if (tester.testReadPipeline()) // should return true
+        cout << "\ttestReadPipeline() returned true." << endl;
+    else
+        cout << "\ttestReadPipeline() returned false." << endl;
+
+    if (tester.testPrefilter()) // should return true
+        cout << "\ttestPrefilter() returned true." << endl;
+    else
+        cout << "\ttestPrefilter() returned false." << endl;
+
+    if (tester.testIdIndex()) // should return true
+        cout << "\ttestIdIndex() returned true." << endl;
+    else
+        cout << "\ttestIdIndex() returned false." << endl;
+
+    if (tester.testFindAll()) // should return true
+        cout << "\ttestFindAll() returned true." << endl;
+    else
+        cout << "\ttestFindAll() returned false." << endl;
+
+    if (tester.testHammingLookup()) // should return true
+        cout << "\ttestHammingLookup() returned true." << endl;
+    else
+        cout << "\ttestHammingLookup() returned false." << endl;
+
+    if (tester.testLiveIteration()) // should return true
+        cout << "\ttestLiveIteration() returned true." << endl;
+    else
+        cout << "\ttestLiveIteration() returned false." << endl;
+
+    if (tester.testOperationStats()) // should return true
+        cout << "\ttestOperationStats() returned true." << endl;
+    else
+        cout << "\ttestOperationStats() returned false." << endl;
+
+    if (tester.testStashOverflow()) // should return true
+        cout << "\ttestStashOverflow() returned true." << endl;
+    else
+        cout << "\ttestStashOverflow() returned false." << endl;
+
+    if (tester.testPrefilterChurn()) // should return true
+        cout << "\ttestPrefilterChurn() returned true." << endl;
+    else
+        cout << "\ttestPrefilterChurn() returned false." << endl;
+
     vector<Virus> dataList;
     Random RndID(MINID,MAXID);
     VDetect vdetect(MINPRIME, hashCode, DOUBLEHASH);
@@ -181,6 +359,15 @@ unsigned int hashCode(const string str) {
     return val ;
 }
 
+unsigned int countingHashCode(const string str) {
+    hashCalls++;
+    return hashCode(str);
+}
+
+unsigned int constantHashCode(const string) {
+    return 7; // every key collides
+}
+
 string sequencer(int size, int seedNum){
     //this function returns a random DNA sequence
     string sequence = "";
@@ -663,3 +850,1553 @@ bool Tester::testRehashDeleteRatio() {
 }
 
 
+
+//Function: Tester::testPackedKeys
+//Case: Pack short, long and non DNA keys and check they come back the same, than insert 31 and 40 base
+// keys in a table using the packed hash and check that all of them can be found
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testPackedKeys() {
+    vector<Virus> dataList;
+    Random RndID(MINID,MAXID);
+    VDetect vdetect(MINPRIME, packedHashCode, DOUBLEHASH);
+    bool result = true;
+
+    string longKey = sequencer(40, 7);
+    result = result && (PackedKey("ACGT").toString() == "ACGT" && PackedKey("ACGT").isDna());
+    result = result && (PackedKey(longKey).toString() == longKey && PackedKey(longKey).wordCount() == 2);
+    result = result && (PackedKey("DELETED").toString() == "DELETED" && !PackedKey("DELETED").isDna());
+    result = result && (PackedKey("A") != PackedKey("AA")); // same bits, different length
+    result = result && (PackedKey(longKey) == PackedKey(longKey) && PackedKey(longKey).hash() == packedHashCode(longKey));
+    result = result && (sizeof(Slot) < sizeof(Virus)); // the table slot is smaller than the user object
+
+    for (int i=0;i<40;i++){
+        Virus dataObj = Virus(sequencer(i % 2 ? 31 : 40, i), RndID.getRandNum());
+        dataList.push_back(dataObj);
+        vdetect.insert(dataObj);
+    }
+
+    // checking whether all data are inserted
+    for (vector<Virus>::iterator it = dataList.begin(); it != dataList.end(); it++){
+        result = result && (*it == vdetect.getVirus((*it).getKey(), (*it).getID()));
+    }
+
+    return result;
+}
+
+//Function: Tester::testSwissTableProbing
+//Case: Insert 60 nodes and 5 nodes with the same key using group probing so it rehashes, remove the colliding
+// ones and test that the control bytes and the lookups agree, than switch a DOUBLEHASH table over to group probing
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testSwissTableProbing() {
+    vector<Virus> dataList;
+    Random RndID(MINID,MAXID);
+    VDetect vdetect(MINPRIME, hashCode, SWISSTABLE);
+    bool result = true;
+
+    for (int i=0;i<60;i++){
+        Virus dataObj = Virus(sequencer(5, i), RndID.getRandNum());
+        dataList.push_back(dataObj);
+        vdetect.insert(dataObj);
+    }
+    for (int i=0;i<5;i++){
+        Virus dataObj = Virus("A", 1000 + i); // all of them share one home slot
+        vdetect.insert(dataObj);
+    }
+
+    // checking whether all data are inserted
+    for (vector<Virus>::iterator it = dataList.begin(); it != dataList.end(); it++){
+        result = result && (*it == vdetect.getVirus((*it).getKey(), (*it).getID()));
+    }
+
+    for (int i=0;i<5;i++){
+        result = result && (vdetect.getVirus("A", 1000 + i) == Virus("A", 1000 + i));
+        result = result && vdetect.remove(Virus("A", 1000 + i));
+        result = result && (vdetect.getVirus("A", 1000 + i) == EMPTY);
+    }
+
+    size_t live = 0;
+    for (size_t i = 0; i < vdetect.m_currentCap; i++) { // a live control byte always has a live slot behind it
+        result = result && ((vdetect.m_currentCtrl[i] >= 0) == vdetect.m_currentTable[i].isLive());
+        live += vdetect.m_currentCtrl[i] >= 0;
+    }
+    result = result && (live == vdetect.m_currentSize - vdetect.m_currNumDeleted);
+
+    VDetect policyChange(MINPRIME, hashCode, DOUBLEHASH);
+    for (vector<Virus>::iterator it = dataList.begin(); it != dataList.begin() + 20; it++){
+        policyChange.insert(*it);
+    }
+    policyChange.changeProbPolicy(SWISSTABLE);
+    for (vector<Virus>::iterator it = dataList.begin() + 20; it != dataList.begin() + 30; it++){
+        policyChange.insert(*it);
+    }
+    result = result && (policyChange.m_currProbing == SWISSTABLE && policyChange.m_oldTable == nullptr);
+    for (vector<Virus>::iterator it = dataList.begin(); it != dataList.begin() + 30; it++){
+        result = result && (*it == policyChange.getVirus((*it).getKey(), (*it).getID()));
+    }
+
+    return result;
+}
+
+//Function: Tester::testCachedHash
+//Case: Insert 60 nodes with a hash function that counts its calls so the table rehashes to completion,
+// than look all of them up and test that every operation called the hash function exactly once
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testCachedHash() {
+    vector<Virus> dataList;
+    Random RndID(MINID,MAXID);
+    VDetect vdetect(MINPRIME, countingHashCode, DOUBLEHASH);
+    bool result = true;
+
+    hashCalls = 0;
+    for (int i=0;i<60;i++){
+        Virus dataObj = Virus(sequencer(5, i), RndID.getRandNum());
+        dataList.push_back(dataObj);
+        vdetect.insert(dataObj);
+    }
+    result = result && (hashCalls == 60); // migrating the old table did not hash anything
+    result = result && (vdetect.m_oldTable == nullptr && vdetect.m_currentCap != MINPRIME);
+
+    hashCalls = 0;
+    // checking whether all data are inserted
+    for (vector<Virus>::iterator it = dataList.begin(); it != dataList.end(); it++){
+        result = result && (*it == vdetect.getVirus((*it).getKey(), (*it).getID()));
+    }
+    result = result && (hashCalls == 60); // one call per lookup for both tables and every probe
+
+    for (size_t i = 0; i < vdetect.m_currentCap; i++) { // every live slot keeps the hash of its key
+        if (vdetect.m_currentTable[i].isLive())
+            result = result && (vdetect.m_currentTable[i].m_hash == hashCode(vdetect.m_currentTable[i].m_key.toString()));
+    }
+
+    return result;
+}
+
+//Function: Tester::testLargeCapacities
+//Case: Create a prime table above the old 99991 limit, than insert 600 nodes in power of two tables
+// for every probing policy so they rehash to a bigger power of two, and test that all of them are found
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testLargeCapacities() {
+    vector<Virus> dataList;
+    Random RndID(MINID,MAXID);
+    bool result = true;
+
+    VDetect large(200000, hashCode, DOUBLEHASH);
+    result = result && (large.m_currentCap == large.findNextPrime(200000) && large.m_currentCap > 99991);
+
+    for (int i=0;i<600;i++){
+        dataList.push_back(Virus(sequencer(12, i), RndID.getRandNum()));
+    }
+
+    prob_t policies[3] = {QUADRATIC, DOUBLEHASH, SWISSTABLE};
+    for (int p = 0; p < 3; p++) {
+        VDetect vdetect(1000, packedHashCode, policies[p], POW2CAP);
+        result = result && (vdetect.m_currentCap == 1024);
+        for (vector<Virus>::iterator it = dataList.begin(); it != dataList.end(); it++){
+            vdetect.insert(*it);
+        }
+        result = result && (vdetect.m_currentCap == 4096); // the next power of two above 4 times the live entries
+        // checking whether all data are inserted
+        for (vector<Virus>::iterator it = dataList.begin(); it != dataList.end(); it++){
+            result = result && (*it == vdetect.getVirus((*it).getKey(), (*it).getID()));
+        }
+    }
+
+    return result;
+}
+
+//Function: Tester::testStaticVDetect
+//Case: Insert 300 nodes in compile time specialized tables so they rehash to completion, remove half of
+// them and test that the removed ones are gone and the rest can still be found; then fill NoProbe
+// tables, also with several IDs per key, and test that insert reports every virus it could not
+// store and loses none it did
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testStaticVDetect() {
+    vector<Virus> dataList;
+    Random RndID(MINID,MAXID);
+    StaticVDetect<DoubleHashProbe> packed(MINPRIME);
+    StaticVDetect<QuadraticProbe, FnHasher<hashCode> > userHash(MINPRIME);
+    bool result = true;
+
+    for (int i=0;i<300;i++){
+        Virus dataObj = Virus(sequencer(10, i), RndID.getRandNum());
+        dataList.push_back(dataObj);
+        result = result && packed.insert(dataObj) && userHash.insert(dataObj);
+    }
+    result = result && !packed.insert(dataList[0]); // duplicates are rejected
+    result = result && (packed.m_old.slots == nullptr && packed.m_current.cap == 2048);
+
+    for (int i=0;i<300;i+=2){
+        result = result && packed.remove(dataList[i]) && userHash.remove(dataList[i]);
+    }
+
+    for (int i=0;i<300;i++){
+        bool kept = i % 2 == 1;
+        result = result && ((packed.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == kept);
+        result = result && ((userHash.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == kept);
+    }
+
+    // one slot per hash: the second key of a constant hash is refused, and entries whose migration
+    // collides with newer ones make the table grow instead of being lost
+    StaticVDetect<NoProbe, FnHasher<constantHashCode> > colliding(MINPOW2);
+    result = result && colliding.insert(dataList[1]) && !colliding.insert(dataList[3]);
+    result = result && (colliding.getVirus(dataList[1].getKey(), dataList[1].getID()) == dataList[1]);
+    result = result && (colliding.getVirus(dataList[3].getKey(), dataList[3].getID()) == EMPTY);
+    StaticVDetect<NoProbe> growing(MINPOW2);
+    vector<Virus> stored;
+    for (int i=0;growing.m_old.slots == nullptr;i++){
+        Virus virus(sequencer(12, i), MINID + i);
+        if (growing.insert(virus))
+            stored.push_back(virus);
+    }
+    size_t waiting = growing.m_cursor; // an old entry the migration has not reached
+    while (growing.m_old.ctrl[waiting] < 0)
+        waiting++;
+    size_t cap = growing.m_current.cap;
+    size_t target = homeSlot<POW2CAP>(growing.m_old.slots[waiting].m_hash, cap);
+    int taker = 10000; // a new key takes that entry's slot first
+    while (homeSlot<POW2CAP>(packedHashCode(sequencer(12, taker)), cap) != target)
+        taker++;
+    result = result && growing.insert(Virus(sequencer(12, taker), MINID));
+    stored.push_back(Virus(sequencer(12, taker), MINID));
+    while (growing.m_old.slots != nullptr)
+        growing.remove(Virus("ACGT", MINID));
+    result = result && (growing.m_current.cap > cap); // rebuilt at twice the size
+    for (size_t i=0;i<stored.size();i++){
+        result = result && (growing.getVirus(stored[i].getKey(), stored[i].getID()) == stored[i]);
+    }
+
+    // a second ID of a key whose first ID waits in the old table is refused: the first ID is moved
+    // into its slot before the new one is placed, so the migration has nothing to lose
+    StaticVDetect<NoProbe> ids(MINPOW2);
+    stored.clear();
+    for (int i=0;ids.m_old.slots == nullptr;i++){
+        Virus virus(sequencer(12, i), MINID + i);
+        if (ids.insert(virus))
+            stored.push_back(virus);
+    }
+    waiting = ids.m_cursor;
+    while (ids.m_old.ctrl[waiting] < 0)
+        waiting++;
+    Virus first = ids.m_old.slots[waiting].toVirus();
+    result = result && !ids.insert(Virus(first.getKey(), MAXID));
+    result = result && (ids.getVirus(first.getKey(), MAXID) == EMPTY);
+    while (ids.m_old.slots != nullptr)
+        ids.remove(Virus("ACGT", MINID));
+    for (size_t i=0;i<stored.size();i++){
+        result = result && (ids.getVirus(stored[i].getKey(), stored[i].getID()) == stored[i]);
+    }
+    return result;
+}
+
+//Function: Tester::testConcurrentVDetect
+//Case: 8 threads insert 500 nodes each into a sharded table while looking up what they inserted, than
+// they remove half of their nodes, test the size and that every remaining node is found
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testConcurrentVDetect() {
+    const int THREADS = 8;
+    const int PERTHREAD = 500;
+    ConcurrentVDetect vdetect(MINPRIME, packedHashCode, DOUBLEHASH, 16);
+    vector<Virus> dataList;
+    bool results[THREADS];
+    bool result = true;
+
+    for (int i=0;i<THREADS*PERTHREAD;i++){
+        dataList.push_back(Virus(sequencer(12, i), MINID + i % (MAXID - MINID)));
+    }
+
+    vector<thread> workers;
+    for (int t = 0; t < THREADS; t++) {
+        workers.push_back(thread([&, t]() {
+            bool ok = true;
+            for (int i = t * PERTHREAD; i < (t + 1) * PERTHREAD; i++) {
+                ok = ok && vdetect.insert(dataList[i]);
+                ok = ok && (vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]);
+            }
+            for (int i = t * PERTHREAD; i < (t + 1) * PERTHREAD; i += 2) {
+                ok = ok && vdetect.remove(dataList[i]);
+            }
+            results[t] = ok;
+        }));
+    }
+    for (int t = 0; t < THREADS; t++) {
+        workers[t].join();
+        result = result && results[t];
+    }
+
+    result = result && (vdetect.size() == THREADS * PERTHREAD / 2);
+    for (int i=0;i<THREADS*PERTHREAD;i++){
+        bool kept = i % 2 == 1;
+        result = result && ((vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == kept);
+    }
+
+    return result;
+}
+
+//Function: Tester::testLockFreeReaders
+//Case: 4 threads keep looking up 200 long keys while 2 threads insert and remove other long keys,
+// so the shards rehash and free key words under the readers; then readers look up IDs of one key
+// that a cuckoo shard keeps in its stash across rehashes, than every retired buffer is reclaimed
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testLockFreeReaders() {
+    const int READERS = 4;
+    const int WRITERS = 2;
+    const int STABLE = 200;
+    const int CHURN = 2000;
+    ConcurrentVDetect vdetect(MINPRIME, packedHashCode, QUADRATIC, 2);
+    vector<Virus> stable;
+    bool results[READERS];
+    bool result = true;
+    atomic<int> writing(WRITERS);
+
+    for (int i=0;i<STABLE;i++){ // 40 bases, the words live on the heap
+        stable.push_back(Virus(sequencer(40, i), MINID + i));
+        result = result && vdetect.insert(stable[i]);
+    }
+
+    vector<thread> workers;
+    for (int t = 0; t < WRITERS; t++) {
+        workers.push_back(thread([&, t]() {
+            for (int i = 0; i < CHURN; i++) {
+                Virus virus(sequencer(40, 10000 + t * CHURN + i), MINID + i % 100);
+                vdetect.insert(virus);
+                if (i % 3 != 0)
+                    vdetect.remove(virus);
+            }
+            writing--;
+        }));
+    }
+    for (int t = 0; t < READERS; t++) {
+        workers.push_back(thread([&, t]() {
+            bool ok = true;
+            for (int i = t; writing > 0; i = (i + 1) % STABLE) {
+                ok = ok && (vdetect.getVirus(stable[i].getKey(), stable[i].getID()) == stable[i]);
+                ok = ok && (vdetect.getVirus(stable[i].getKey(), MAXID) == EMPTY);
+            }
+            results[t] = ok;
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+    for (int t = 0; t < READERS; t++) {
+        result = result && results[t];
+    }
+
+    result = result && (vdetect.size() == STABLE + WRITERS * ((CHURN + 2) / 3)); // every third churn key stays
+
+    // 12 IDs of one long key in a cuckoo shard, the ones its buckets can't hold sit in the stash
+    // and are moved out of it, words and all, by every rehash the writer causes
+    ConcurrentVDetect cuckoo(MINPOW2, packedHashCode, CUCKOO, 1, POW2CAP);
+    for (int i=0;i<12;i++){
+        result = result && cuckoo.insert(Virus(sequencer(40, 7), MINID + i));
+    }
+    result = result && (cuckoo.m_shards[0].table->m_stashSize == 12 - 2 * BUCKETWAYS);
+    writing = 1;
+    thread writer([&]() {
+        for (int i = 0; i < CHURN; i++)
+            cuckoo.insert(Virus(sequencer(40, 20000 + i), MINID + i % 100));
+        writing--;
+    });
+    vector<thread> readers;
+    for (int t = 0; t < READERS; t++) {
+        readers.push_back(thread([&, t]() {
+            bool ok = true;
+            for (int i = t; writing > 0; i = (i + 1) % 12)
+                ok = ok && cuckoo.contains(sequencer(40, 7), MINID + i);
+            results[t] = ok;
+        }));
+    }
+    writer.join();
+    for (size_t t = 0; t < readers.size(); t++) {
+        readers[t].join();
+        result = result && results[t];
+    }
+
+    EpochDomain::instance().reclaim(); // no reader is left, nothing can stay pending
+    result = result && (EpochDomain::instance().pending() == 0);
+    return result;
+}
+
+//Function: Tester::testBatchOperations
+//Case: the same 1000 nodes, a duplicate and a node with a bad ID go through insertBatch on one table
+// and insert on another, than half of them through removeBatch and remove, and every node is looked up
+// with getVirusBatch
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testBatchOperations() {
+    VDetect batched(MINPRIME, hashCode, DOUBLEHASH);
+    VDetect single(MINPRIME, hashCode, DOUBLEHASH);
+    vector<Virus> dataList;
+    vector<Virus> removeList;
+    bool result = true;
+
+    for (int i=0;i<1000;i++){
+        dataList.push_back(Virus(sequencer(12, i), MINID + i));
+    }
+    dataList.push_back(dataList[5]);
+    dataList.push_back(Virus(sequencer(12, 5000), 1));
+    for (size_t i=0;i<dataList.size();i++){
+        single.insert(dataList[i]);
+    }
+    result = result && (batched.insertBatch(dataList) == 1000);
+
+    for (int i=0;i<1000;i+=2){
+        removeList.push_back(dataList[i]);
+        single.remove(dataList[i]);
+    }
+    result = result && (batched.removeBatch(removeList) == 500);
+    // both tables went through the same rehashes
+    result = result && (batched.m_currentCap == single.m_currentCap) && (batched.liveCount() == single.liveCount());
+
+    vector<Virus> found = batched.getVirusBatch(dataList);
+    for (int i=0;i<1000;i++){
+        result = result && ((found[i] == dataList[i]) == (i % 2 == 1));
+    }
+    result = result && (found[1001] == EMPTY);
+    return result;
+}
+
+//Function: Tester::testBackgroundRehash
+//Case: 3000 nodes are inserted while a background thread migrates the old tables, every node is
+// looked up right after its insert, than we wait for the migration and look everything up again
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testBackgroundRehash() {
+    VDetect vdetect(MINPRIME, hashCode, QUADRATIC);
+    vector<Virus> dataList;
+    bool result = true;
+    vdetect.setBackgroundRehash(true);
+
+    for (int i=0;i<3000;i++){
+        dataList.push_back(Virus(sequencer(12, i), MINID + i % (MAXID - MINID)));
+        result = result && vdetect.insert(dataList[i]);
+        result = result && (vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]);
+    }
+    for (int i=0;i<3000;i+=3){
+        result = result && vdetect.remove(dataList[i]);
+    }
+
+    vdetect.waitForRehash();
+    result = result && !vdetect.isRehashing() && (vdetect.m_oldTable == nullptr);
+    result = result && (vdetect.liveCount() == 2000);
+    for (int i=0;i<3000;i++){
+        result = result && ((vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == (i % 3 != 0));
+    }
+    vdetect.setBackgroundRehash(false); // the thread is stopped, the table keeps working on its own
+    result = result && vdetect.insert(dataList[0]);
+    return result;
+}
+
+//Function: Tester::testMigrationBudget
+//Case: a table rehashes at a load factor of 0.25 and migrates 16 old slots per operation,
+// 1000 nodes are inserted and every node is looked up after each insert
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testMigrationBudget() {
+    VDetect vdetect(MINPRIME, hashCode, QUADRATIC);
+    vector<Virus> dataList;
+    bool result = true;
+    vdetect.setRehashThresholds(0.25, DEFMAXDELETED);
+    vdetect.setMigrationBudget(16);
+
+    for (int i=0;i<26;i++){ // 26 entries is just above a quarter of 101 slots
+        dataList.push_back(Virus(sequencer(12, i), MINID + i));
+        vdetect.insert(dataList[i]);
+    }
+    result = result && (vdetect.m_oldTable != nullptr) && (vdetect.m_oldCap == MINPRIME);
+    result = result && (vdetect.m_cursor == 16); // the operation that started the rehash scanned 16 slots
+
+    for (int i=26;i<1000;i++){
+        size_t cursor = vdetect.m_cursor;
+        Slot* old = vdetect.m_oldTable;
+        dataList.push_back(Virus(sequencer(12, i), MINID + i));
+        vdetect.insert(dataList[i]);
+        if (old != nullptr && vdetect.m_oldTable == old) // same migration, the cursor moved 16 slots at most
+            result = result && (vdetect.m_cursor - cursor <= 16);
+        for (int j=0;j<=i;j+=50){
+            result = result && (vdetect.getVirus(dataList[j].getKey(), dataList[j].getID()) == dataList[j]);
+        }
+    }
+    vdetect.waitForRehash();
+    result = result && (vdetect.m_oldTable == nullptr) && (vdetect.liveCount() == 1000);
+    for (int i=0;i<1000;i++){
+        result = result && (vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]);
+    }
+    return result;
+}
+
+//Function: Tester::testRobinHoodProbing
+//Case: 40 nodes stay in a ROBINHOOD table while 2000 other nodes are inserted and removed again,
+// test that no slot is DELETED, that no rehash happened and that the Robin Hood order holds; a table
+// that never rehashes for load is filled past its capacity and no stored node may be evicted
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testRobinHoodProbing() {
+    VDetect vdetect(MINPRIME, hashCode, ROBINHOOD);
+    vector<Virus> dataList;
+    bool result = true;
+
+    for (int i=0;i<40;i++){
+        dataList.push_back(Virus(sequencer(12, i), MINID + i));
+        result = result && vdetect.insert(dataList[i]);
+    }
+    for (int i=0;i<2000;i++){
+        Virus churn(sequencer(12, 1000 + i), MINID + i % 100);
+        result = result && vdetect.insert(churn);
+        result = result && vdetect.remove(churn);
+    }
+
+    result = result && (vdetect.m_oldTable == nullptr) && (vdetect.m_currentCap == MINPRIME);
+    result = result && (vdetect.m_currNumDeleted == 0) && (vdetect.m_currentSize == 40);
+    for (size_t i=0;i<vdetect.m_currentCap;i++){
+        size_t next = (i + 1) % vdetect.m_currentCap;
+        result = result && (vdetect.m_currentCtrl[i] != CTRLDELETED);
+        // an entry is never further from its home than the entry before it plus one
+        if (vdetect.m_currentCtrl[i] >= 0 && vdetect.m_currentCtrl[next] >= 0) {
+            size_t mine = probeDistance(vdetect.m_currentTable[i].m_hash % MINPRIME, i, MINPRIME);
+            size_t theirs = probeDistance(vdetect.m_currentTable[next].m_hash % MINPRIME, next, MINPRIME);
+            result = result && (theirs <= mine + 1);
+        }
+    }
+    for (int i=0;i<40;i++){
+        result = result && (vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]);
+    }
+
+    VDetect full(MINPRIME, hashCode, ROBINHOOD);
+    full.setRehashThresholds(1.0, DEFMAXDELETED);
+    vector<bool> stored;
+    for (int i=0;i<MINPRIME + 20;i++){
+        stored.push_back(full.insert(Virus(sequencer(12, 5000 + i), MINID + i)));
+        for (int j=0;j<=i;j++){ // every insert that returned true is still there
+            result = result && (full.contains(sequencer(12, 5000 + j), MINID + j) == stored[j]);
+        }
+    }
+    return result;
+}
+
+//Function: Tester::testCuckooHashing
+//Case: a CUCKOO table is filled to a load factor of 0.9 with power of two and prime capacities,
+// every node must sit in one of its two buckets, than half are removed; a QUADRATIC table whose
+// keys all collide gets 60 nodes, more than its probe sequence reaches, and the stash keeps them
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testCuckooHashing() {
+    bool result = true;
+    for (int mode = PRIMECAP; mode <= POW2CAP; mode++) {
+        VDetect vdetect(1024, hashCode, CUCKOO, cap_t(mode));
+        vector<Virus> dataList;
+        vdetect.setRehashThresholds(0.9, DEFMAXDELETED);
+        size_t cap = vdetect.m_currentCap;
+        int count = int(cap * 0.9);
+
+        for (int i=0;i<count;i++){
+            dataList.push_back(Virus(sequencer(12, i), MINID + i % (MAXID - MINID)));
+            result = result && vdetect.insert(dataList[i]);
+        }
+        result = result && (vdetect.m_currentCap == cap) && (vdetect.liveCount() == size_t(count));
+        for (size_t i=0;i<vdetect.m_currentCap;i++){
+            if (vdetect.m_currentCtrl[i] >= 0) {
+                size_t first, second;
+                vdetect.cuckooBucketsOf(vdetect.m_currentTable[i].m_hash, first, second);
+                result = result && (i / BUCKETWAYS == first || i / BUCKETWAYS == second);
+            }
+        }
+        for (int i=0;i<count;i+=2){
+            result = result && vdetect.remove(dataList[i]);
+        }
+        for (int i=0;i<count;i++){
+            result = result && ((vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == (i % 2 == 1));
+        }
+    }
+
+    VDetect colliding(MINPRIME, constantHashCode, QUADRATIC);
+    vector<Virus> dataList;
+    colliding.setRehashThresholds(1.0, DEFMAXDELETED);
+    for (int i=0;i<60;i++){ // only 50 slots are on the probe sequence of a 101 slot table
+        dataList.push_back(Virus(sequencer(12, i), MINID + i));
+        result = result && colliding.insert(dataList[i]);
+    }
+    for (int i=0;i<60;i++){
+        result = result && (colliding.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]);
+    }
+    return result;
+}
+
+//Function: Tester::testStringViewLookup
+//Case: 100 keys are cut out of one long read as string_views and emplaced, than they are looked up
+// through contains, findEntry and findVirus, in a VDetect and in a ConcurrentVDetect
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testStringViewLookup() {
+    string read = sequencer(200, 7);
+    string_view window(read);
+    VDetect vdetect(MINPRIME, packedHashCode, DOUBLEHASH);
+    ConcurrentVDetect shared(MINPRIME, packedHashCode, DOUBLEHASH, 4);
+    bool result = true;
+
+    for (int i=0;i<100;i++){ // overlapping keys of 20 bases, no string is built for them
+        result = result && vdetect.emplace(window.substr(i, 20), MINID + i);
+        result = result && shared.insert(Virus(string(window.substr(i, 20)), MINID + i));
+    }
+    result = result && !vdetect.emplace(window.substr(0, 20), MINID); // a duplicate
+
+    for (int i=0;i<100;i++){
+        string_view key = window.substr(i, 20);
+        result = result && vdetect.contains(key, MINID + i) && !vdetect.contains(key, MINID + i + 1);
+        result = result && shared.contains(key, MINID + i);
+        const Slot* slot = vdetect.findEntry(key, MINID + i);
+        result = result && (slot != nullptr) && (slot->getID() == MINID + i) && (slot->getKey() == PackedKey(key));
+        optional<Virus> virus = vdetect.findVirus(key, MINID + i);
+        result = result && virus.has_value() && (*virus == Virus(string(key), MINID + i));
+    }
+    result = result && !vdetect.findVirus(window.substr(150, 20), MINID).has_value();
+    result = result && (vdetect.findEntry(window.substr(150, 20), MINID) == nullptr);
+    return result;
+}
+
+//Function: Tester::testKeyArena
+//Case: 500 keys of 40 bases are inserted, half are removed and a policy change rehashes the table,
+// test that the slots borrow their words from the arena and that the rehash left only live keys in it
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testKeyArena() {
+    VDetect vdetect(MINPRIME, packedHashCode, DOUBLEHASH);
+    vector<Virus> dataList;
+    bool result = true;
+
+    for (int i=0;i<500;i++){
+        dataList.push_back(Virus(sequencer(40, i), MINID + i));
+        result = result && vdetect.insert(dataList[i]);
+    }
+    vdetect.waitForRehash();
+    for (size_t i=0;i<vdetect.m_currentCap;i++){
+        if (vdetect.m_currentCtrl[i] >= 0)
+            result = result && vdetect.m_currentTable[i].m_key.m_borrowed;
+    }
+
+    for (int i=0;i<500;i+=2){
+        result = result && vdetect.remove(dataList[i]);
+    }
+    vdetect.changeProbPolicy(QUADRATIC);
+    vdetect.insert(dataList[0]); // starts the rehash
+    vdetect.waitForRehash();
+    // 251 live keys of two words each, the removed ones were not copied
+    result = result && (vdetect.m_currentArena->wordsUsed() == 251 * 2);
+    for (int i=0;i<500;i++){
+        result = result && ((vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == (i % 2 == 1 || i == 0));
+    }
+    return result;
+}
+
+//Function: Tester::testKmerVDetect
+//Case: 2000 21-mers and 2000 40-mers go into k-mer tables, keys of another length are refused,
+// half are removed, test the slot size, the hashes against packedHashCode and every lookup; then
+// 4-mers fill a NoProbe table, test that insert and size only count the stored ones
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testKmerVDetect() {
+    KmerVDetect<21> short21(MINPOW2);
+    KmerVDetect<40, QuadraticProbe> long40(MINPOW2);
+    vector<Virus> list21;
+    vector<Virus> list40;
+    bool result = true;
+    result = result && (sizeof(KmerVDetect<21>::Entry) == 16);
+
+    for (int i=0;i<2000;i++){
+        list21.push_back(Virus(sequencer(21, i), MINID + i));
+        list40.push_back(Virus(sequencer(40, i), MINID + i));
+        result = result && short21.insert(list21[i]) && long40.insert(list40[i]);
+        Kmer<21> kmer;
+        result = result && kmer.pack(list21[i].getKey()) && (kmer.hash() == packedHashCode(list21[i].getKey()));
+        result = result && (kmer.toString() == list21[i].getKey());
+    }
+    result = result && !short21.insert(Virus(sequencer(20, 1), MINID)) && !short21.insert(Virus("ACGTACGTACGTACGTACGTN", MINID));
+
+    for (int i=0;i<2000;i+=2){
+        result = result && short21.remove(list21[i]) && long40.remove(list40[i]);
+    }
+    result = result && (short21.size() == 1000) && (long40.size() == 1000);
+    for (int i=0;i<2000;i++){
+        bool kept = i % 2 == 1;
+        result = result && ((short21.getVirus(list21[i].getKey(), list21[i].getID()) == list21[i]) == kept);
+        result = result && (long40.contains(list40[i].getKey(), list40[i].getID()) == kept);
+    }
+
+    // 4-mers with one slot per hash: IDs of a stored 4-mer collide, insert reports each one it refused
+    KmerVDetect<4, NoProbe> single(MINPOW2);
+    size_t accepted = 0;
+    bool refused = false;
+    for (int i=0;i<200;i++){
+        bool stored = single.insert(Virus(sequencer(4, i), MINID + i));
+        accepted += stored;
+        refused = refused || !stored;
+        result = result && (single.contains(sequencer(4, i), MINID + i) == stored);
+    }
+    result = result && refused && (single.size() == accepted);
+    return result;
+}
+
+//Function: Tester::testMappedSnapshot
+//Case: short, 40-base and raw keys go into a cuckoo table and a hashCode table, some are removed,
+// both are saved and mapped back, test every lookup, the size, a mismatched hash, bad, corrupt and
+// out of range files and a save over a file that is still mapped
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testMappedSnapshot() {
+    VDetect packed(MINPOW2, packedHashCode, CUCKOO, POW2CAP);
+    VDetect custom(MINPRIME, hashCode, DOUBLEHASH);
+    vector<Virus> dataList;
+    bool result = true;
+
+    for (int i=0;i<1200;i++){
+        string key = i % 3 == 0 ? sequencer(5, i) : (i % 3 == 1 ? sequencer(40, i) : "raw-" + to_string(i));
+        dataList.push_back(Virus(key, MINID + i));
+        result = result && packed.insert(dataList[i]) && custom.insert(dataList[i]);
+    }
+    for (int i=0;i<12;i++){ // more IDs of one key than two buckets hold, some may sit in the stash
+        dataList.push_back(Virus(sequencer(40, 7), MAXID - i));
+        result = result && packed.insert(dataList.back()) && custom.insert(dataList.back());
+    }
+    for (size_t i=0;i<dataList.size();i+=4){
+        result = result && packed.remove(dataList[i]) && custom.remove(dataList[i]);
+    }
+    size_t live = packed.liveCount();
+    result = result && MappedVDetect::save(packed, "vdetect_packed.snap") && MappedVDetect::save(custom, "vdetect_custom.snap");
+
+    MappedVDetect mappedPacked;
+    MappedVDetect mappedCustom;
+    result = result && mappedPacked.open("vdetect_packed.snap", packedHashCode) && mappedCustom.open("vdetect_custom.snap", hashCode);
+    result = result && (mappedPacked.size() == live) && (mappedCustom.size() == live);
+    for (size_t i=0;i<dataList.size();i++){
+        bool kept = i % 4 != 0;
+        result = result && ((mappedPacked.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == kept);
+        result = result && (mappedCustom.contains(dataList[i].getKey(), dataList[i].getID()) == kept);
+    }
+    result = result && !mappedPacked.contains(sequencer(40, 1), MINID + 2); // right key, wrong id
+
+    // a packed snapshot opened with another hash, a file that is not a snapshot and a truncated one
+    MappedVDetect bad;
+    result = result && !bad.open("vdetect_packed.snap", hashCode) && !bad.isOpen();
+    {
+        ofstream garbage("vdetect_bad.snap", ios::binary);
+        garbage << string(200, 'x');
+    }
+    result = result && !bad.open("vdetect_bad.snap", packedHashCode);
+    {
+        ifstream in("vdetect_packed.snap", ios::binary);
+        string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        ofstream truncated("vdetect_bad.snap", ios::binary | ios::trunc);
+        truncated.write(bytes.data(), bytes.size() / 2);
+    }
+    result = result && !bad.open("vdetect_bad.snap", packedHashCode) && !bad.open("vdetect_none.snap", packedHashCode);
+
+    // well formed files of empty slots: a cuckoo table with fewer slots than one bucket, power of two
+    // tables of a capacity that is not one or below MINPOW2 and a stash larger than STASHSIZE are
+    // refused, a long key pointing past the arena too
+    auto writeSnapshot = [](prob_t probing, size_t cap, size_t stashCount) {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOTMAGIC, sizeof(header.magic));
+        header.version = SNAPSHOTVERSION;
+        header.probing = probing;
+        header.capMode = POW2CAP;
+        header.hashId = HASHPACKED;
+        header.cap = cap;
+        header.stashCount = stashCount;
+        header.ctrlOffset = (sizeof(header) + 7) / 8 * 8;
+        header.slotOffset = (header.ctrlOffset + header.cap + GROUPWIDTH - 1 + 7) / 8 * 8;
+        header.stashOffset = header.slotOffset + header.cap * sizeof(SnapshotSlot);
+        header.arenaOffset = header.stashOffset + header.stashCount * sizeof(SnapshotSlot);
+        string bytes(header.arenaOffset, char(CTRLEMPTY));
+        memcpy(&bytes[0], &header, sizeof(header));
+        memset(&bytes[header.slotOffset], 0, header.arenaOffset - header.slotOffset);
+        for (size_t i=0;i<stashCount;i++){
+            SnapshotSlot slot;
+            memset(&slot, 0, sizeof(slot));
+            slot.kind = DNAPACKED;
+            slot.id = MINID;
+            memcpy(&bytes[header.stashOffset + i * sizeof(SnapshotSlot)], &slot, sizeof(slot));
+        }
+        ofstream out("vdetect_bad.snap", ios::binary | ios::trunc);
+        out.write(bytes.data(), bytes.size());
+    };
+    writeSnapshot(CUCKOO, BUCKETWAYS - 1, 0);
+    result = result && !bad.open("vdetect_bad.snap", packedHashCode);
+    writeSnapshot(NONE, MINPOW2, STASHSIZE);
+    result = result && bad.open("vdetect_bad.snap", packedHashCode);
+    bad.close();
+    writeSnapshot(NONE, MINPOW2 + 1, 0);
+    result = result && !bad.open("vdetect_bad.snap", packedHashCode);
+    writeSnapshot(NONE, MINPOW2 / 2, 0);
+    result = result && !bad.open("vdetect_bad.snap", packedHashCode);
+    writeSnapshot(NONE, MINPOW2, STASHSIZE + 1);
+    result = result && !bad.open("vdetect_bad.snap", packedHashCode);
+    {
+        ifstream in("vdetect_packed.snap", ios::binary);
+        string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        SnapshotHeader header;
+        memcpy(&header, bytes.data(), sizeof(header));
+        bool corrupted = false;
+        for (size_t i=0;i<header.cap && !corrupted;i++){
+            SnapshotSlot slot;
+            memcpy(&slot, &bytes[header.slotOffset + i * sizeof(SnapshotSlot)], sizeof(slot));
+            if (ctrl_t(bytes[header.ctrlOffset + i]) >= 0 && slot.length == 40) {
+                slot.word = header.arenaWords - 1; // the second word lies past the arena
+                memcpy(&bytes[header.slotOffset + i * sizeof(SnapshotSlot)], &slot, sizeof(slot));
+                corrupted = true;
+            }
+        }
+        ofstream outside("vdetect_bad.snap", ios::binary | ios::trunc);
+        outside.write(bytes.data(), bytes.size());
+        result = result && corrupted;
+    }
+    result = result && !bad.open("vdetect_bad.snap", packedHashCode) && !bad.isOpen();
+
+    // saving over a file that is mapped leaves the mapping on the old file, reopening sees the new one
+    result = result && packed.insert(Virus(sequencer(40, 5000), MINID)) &&
+             MappedVDetect::save(packed, "vdetect_packed.snap");
+    for (size_t i=0;i<dataList.size();i++){
+        result = result && (mappedPacked.contains(dataList[i].getKey(), dataList[i].getID()) == (i % 4 != 0));
+    }
+    result = result && !mappedPacked.contains(sequencer(40, 5000), MINID) && (mappedPacked.size() == live);
+    result = result && mappedPacked.open("vdetect_packed.snap", packedHashCode) &&
+             mappedPacked.contains(sequencer(40, 5000), MINID) && (mappedPacked.size() == live + 1);
+    ifstream leftover("vdetect_packed.snap.tmp");
+    result = result && !leftover;
+
+    mappedPacked.close();
+    result = result && !mappedPacked.contains(dataList[1].getKey(), dataList[1].getID());
+    remove("vdetect_packed.snap");
+    remove("vdetect_custom.snap");
+    remove("vdetect_bad.snap");
+    return result;
+}
+
+//Function: Tester::testJournal
+//Case: inserts and removes of mixed keys are logged, replayed into a new table, a torn record is
+// cut off on reopen, then a checkpoint saves a snapshot and the rest is replayed on top of it;
+// a failed checkpoint keeps the log and checkpoints racing a writer lose no operation
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testJournal() {
+    remove("vdetect_test.wal");
+    VDetect vdetect(MINPRIME, packedHashCode, DOUBLEHASH);
+    Journal journal;
+    vector<Virus> dataList;
+    bool result = journal.open("vdetect_test.wal", chrono::milliseconds(5));
+    vdetect.setJournal(&journal);
+
+    for (int i=0;i<900;i++){
+        string key = i % 3 == 0 ? sequencer(5, i) : (i % 3 == 1 ? sequencer(40, i) : "raw-" + to_string(i));
+        dataList.push_back(Virus(key, MINID + i));
+        result = result && vdetect.insert(dataList[i]);
+    }
+    result = result && !vdetect.insert(dataList[0]); // refused operations are not logged
+    for (int i=0;i<900;i+=3){
+        result = result && vdetect.remove(dataList[i]);
+    }
+    result = result && journal.sync() && (journal.m_durable == journal.m_logged) && journal.m_buffer.empty();
+
+    VDetect replayed(MINPOW2, packedHashCode, CUCKOO, POW2CAP);
+    result = result && (Journal::replay("vdetect_test.wal", replayed) == 1200);
+    for (int i=0;i<900;i++){
+        result = result && ((replayed.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == (i % 3 != 0));
+    }
+
+    // a crash in the middle of a write leaves half a record behind
+    journal.close();
+    {
+        ofstream torn("vdetect_test.wal", ios::binary | ios::app);
+        torn << char(JOURNALINSERT) << char(DNAPACKED) << "\x28\0";
+    }
+    VDetect torn(MINPRIME, packedHashCode, DOUBLEHASH);
+    result = result && (Journal::replay("vdetect_test.wal", torn) == 1200);
+    result = result && journal.open("vdetect_test.wal", chrono::milliseconds(5));
+    dataList.push_back(Virus(sequencer(45, 1), MAXID));
+    result = result && vdetect.insert(dataList.back());
+    journal.close();
+    VDetect reopened(MINPRIME, packedHashCode, DOUBLEHASH);
+    result = result && (Journal::replay("vdetect_test.wal", reopened) == 1201) && reopened.contains(dataList.back().getKey(), MAXID);
+
+    // snapshot plus the operations logged after it
+    result = result && journal.open("vdetect_test.wal") && journal.checkpoint(vdetect, "vdetect_test.snap");
+    result = result && vdetect.remove(dataList[1]) && vdetect.insert(dataList[0]);
+    journal.close();
+    MappedVDetect snapshot;
+    VDetect restored(MINPRIME, packedHashCode, QUADRATIC);
+    result = result && snapshot.open("vdetect_test.snap", packedHashCode) && snapshot.restore(restored);
+    result = result && (Journal::replay("vdetect_test.wal", restored) == 2);
+    result = result && (restored.liveCount() == vdetect.liveCount());
+    for (size_t i=0;i<dataList.size();i++){
+        bool kept = vdetect.contains(dataList[i].getKey(), dataList[i].getID());
+        result = result && (restored.contains(dataList[i].getKey(), dataList[i].getID()) == kept);
+    }
+    result = result && !vdetect.contains(dataList[1].getKey(), dataList[1].getID());
+    VDetect custom(MINPRIME, hashCode, DOUBLEHASH);
+    result = result && !snapshot.restore(custom) && (Journal::replay("vdetect_none.wal", custom) == -1);
+    snapshot.close();
+
+    // a snapshot that can't be written leaves the log alone
+    result = result && journal.open("vdetect_test.wal") && !journal.checkpoint(vdetect, "vdetect_none/x.snap");
+    journal.close();
+    result = result && (Journal::replay("vdetect_test.wal", custom) == 2);
+
+    // a checkpoint while another thread writes: every operation is in the snapshot or the log
+    VDetect busy(MINPRIME, packedHashCode, DOUBLEHASH);
+    busy.setBackgroundRehash(true);
+    remove("vdetect_test.wal");
+    result = result && journal.open("vdetect_test.wal", chrono::milliseconds(1));
+    busy.setJournal(&journal);
+    thread writer([&]() {
+        for (int i=0;i<6000;i++){
+            busy.insert(Virus(sequencer(40, i), MINID + i));
+            if (i % 5 == 0)
+                busy.remove(Virus(sequencer(40, i / 2), MINID + i / 2));
+        }
+    });
+    for (int i=0;i<5;i++){
+        result = result && journal.checkpoint(busy, "vdetect_test.snap");
+    }
+    writer.join();
+    journal.close();
+    busy.setJournal(nullptr);
+    VDetect recovered(MINPRIME, packedHashCode, DOUBLEHASH);
+    result = result && snapshot.open("vdetect_test.snap", packedHashCode) && snapshot.restore(recovered);
+    result = result && (Journal::replay("vdetect_test.wal", recovered) >= 0) && (recovered.liveCount() == busy.liveCount());
+    for (int i=0;i<6000;i++){
+        result = result && (recovered.contains(sequencer(40, i), MINID + i) == busy.contains(sequencer(40, i), MINID + i));
+    }
+
+    vdetect.setJournal(nullptr);
+    snapshot.close();
+    remove("vdetect_test.wal");
+    remove("vdetect_test.snap");
+    return result;
+}
+
+//Function: Tester::testKmerScanner
+//Case: k-mers of 21 and 40 bases taken from random reads are stored, the reads are written as
+// multi-line FASTA and as FASTQ with lower case bases and N's, and scanned with a tiny and the
+// default chunk size; test every hit against slicing each window and calling findKey
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testKmerScanner() {
+    bool result = true;
+    Random base(0, 3);
+    vector<string> reads;
+    for (int r=0;r<12;r++){
+        string read;
+        for (int i=0;i<150 + r * 7;i++)
+            read += ALPHA[base.getRandNum()];
+        if (r % 4 == 1)
+            read[60] = 'N';
+        if (r % 4 == 2)
+            read[10] = 'a'; // soft-masked base
+        reads.push_back(read);
+    }
+
+    for (unsigned int k : {21u, 40u}){
+        for (hash_fn hash : {packedHashCode, hashCode}){
+            VDetect vdetect(MINPRIME, hash, DOUBLEHASH);
+            for (size_t r=0;r<reads.size();r++){
+                for (size_t p=r;p + k <= reads[r].size();p+=13){
+                    string kmer = reads[r].substr(p, k);
+                    if (kmer.find_first_not_of("ACGT") == string::npos)
+                        vdetect.insert(Virus(kmer, MINID + int(p)));
+                }
+            }
+            // what a scan must report: every window whose upper case form is stored
+            vector<KmerHit> expected;
+            for (size_t r=0;r<reads.size();r++){
+                for (size_t p=0;p + k <= reads[r].size();p++){
+                    string kmer = reads[r].substr(p, k);
+                    for (char& c : kmer)
+                        c = toupper(c);
+                    const Slot* slot = vdetect.findKey(kmer);
+                    if (slot != nullptr)
+                        expected.push_back(KmerHit{r, p, slot->getID()});
+                }
+            }
+            result = result && expected.size() > reads.size();
+
+            {
+                ofstream fasta("vdetect_test.fa");
+                ofstream fastq("vdetect_test.fq");
+                for (size_t r=0;r<reads.size();r++){
+                    fasta << ">read" << r << " sample\n";
+                    for (size_t p=0;p<reads[r].size();p+=60)
+                        fasta << reads[r].substr(p, 60) << "\n";
+                    fastq << "@read" << r << "\n" << reads[r] << "\n+\n" << string(reads[r].size(), r % 2 ? '@' : '>') << "\n";
+                }
+            }
+            for (const char* path : {"vdetect_test.fa", "vdetect_test.fq"}){
+                for (size_t chunk : {size_t(7), SCANCHUNK}){
+                    KmerScanner scanner(vdetect, k, chunk);
+                    vector<KmerHit> hits;
+                    bool named = true;
+                    result = result && scanner.scanFile(path, [&](const KmerHit& hit) {
+                        hits.push_back(hit);
+                        named = named && scanner.readName().rfind("read" + to_string(hit.read), 0) == 0;
+                    });
+                    result = result && named && (hits.size() == expected.size()) && (scanner.hits() == hits.size());
+                    result = result && (scanner.reads() == reads.size());
+                    for (size_t i=0;i<hits.size() && i<expected.size();i++){
+                        result = result && (hits[i].read == expected[i].read) && (hits[i].position == expected[i].position) && (hits[i].id == expected[i].id);
+                    }
+                }
+            }
+            KmerScanner single(vdetect, k);
+            size_t count = single.scanSequence(reads[3], 3, [&](const KmerHit& hit) {result = result && hit.read == 3;});
+            result = result && count == size_t(count_if(expected.begin(), expected.end(), [](const KmerHit& hit) {return hit.read == 3;}));
+        }
+    }
+    result = result && !KmerScanner(VDetect(MINPRIME, hashCode, NONE), 21).scanFile("vdetect_none.fa", [](const KmerHit&) {});
+    remove("vdetect_test.fa");
+    remove("vdetect_test.fq");
+    return result;
+}
+
+//Function: Tester::testReadPipeline
+//Case: 400 random reads, the 21-mers of every third one are stored under an ID of that read; the
+// reads are classified from FASTA, FASTQ, both files and a stream with 1 and 4 workers and small
+// and large chunks; test that every run prints the expected line for every read in input order
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testReadPipeline() {
+    const unsigned int K = 21;
+    bool result = true;
+    Random base(0, 3);
+    VDetect vdetect(MINPOW2, packedHashCode, SWISSTABLE, POW2CAP);
+    vector<string> reads;
+    for (int r=0;r<400;r++){
+        string read;
+        for (int i=0;i<80 + (r * 37) % 170;i++)
+            read += ALPHA[base.getRandNum()];
+        reads.push_back(read);
+        for (size_t p=0;r % 3 == 0 && p + K <= read.size();p+=5)
+            vdetect.insert(Virus(read.substr(p, K), MINID + r));
+    }
+
+    string expected;
+    size_t bases = 0;
+    for (size_t r=0;r<reads.size();r++){
+        size_t hits = 0;
+        for (size_t p=0;p + K <= reads[r].size();p++)
+            hits += vdetect.findKey(reads[r].substr(p, K)) != nullptr;
+        expected += "read" + to_string(r) + "\t" + to_string(hits > 0 ? MINID + int(r) : 0) + "\t" + to_string(hits) + "\t" + to_string(reads[r].size()) + "\n";
+        bases += reads[r].size();
+    }
+    {
+        ofstream fasta("vdetect_test.fa");
+        ofstream fastq("vdetect_test.fq");
+        for (size_t r=0;r<reads.size();r++){
+            fasta << ">read" << r << "\n";
+            for (size_t p=0;p<reads[r].size();p+=70)
+                fasta << reads[r].substr(p, 70) << "\n";
+            fastq << "@read" << r << "\n" << reads[r] << "\n+\n" << string(reads[r].size(), '@') << "\n";
+        }
+    }
+
+    for (unsigned int threads : {1u, 4u}){
+        for (size_t chunk : {size_t(500), PIPECHUNK}){
+            ReadPipeline pipeline(vdetect, K, threads, chunk);
+            ostringstream fastaOut;
+            ostringstream fastqOut;
+            ostringstream bothOut;
+            result = result && pipeline.run(vector<string>{"vdetect_test.fa"}, fastaOut) && (fastaOut.str() == expected);
+            result = result && pipeline.run(vector<string>{"vdetect_test.fq"}, fastqOut) && (fastqOut.str() == expected);
+            result = result && (pipeline.stats().reads == reads.size()) && (pipeline.stats().bases == bases);
+            result = result && (pipeline.stats().classified == (reads.size() + 2) / 3) && (pipeline.stats().basesPerSecond() > 0);
+            result = result && pipeline.run(vector<string>{"vdetect_test.fa", "vdetect_test.fq"}, bothOut) && (bothOut.str() == expected + expected);
+            result = result && !pipeline.run(vector<string>{"vdetect_none.fa"}, bothOut);
+        }
+    }
+    ifstream fastq("vdetect_test.fq");
+    ostringstream streamOut;
+    ReadPipeline pipeline(vdetect, K, 3, 1000);
+    result = result && pipeline.run(fastq, streamOut) && (streamOut.str() == expected);
+
+    // a cut never splits a record
+    string text = "@a\nACGT\n+\n@@@@\n@b\nAC\nGT\n+\n@@\n@@\n@c\nAC";
+    result = result && (lastRecordEnd(text, true) == 32) && (lastRecordEnd(">a\nAC\n>b\nGT", false) == 6) && (lastRecordEnd(">a\nACGT", false) == 0);
+    remove("vdetect_test.fa");
+    remove("vdetect_test.fq");
+    return result;
+}
+
+//Function: Tester::testPrefilter
+//Case: the prefilter is turned on for a filled table, entries are inserted and removed through
+// rehashes with a migration budget and a policy change, then the filter is turned off again;
+// test every lookup, that filters never reject a stored key and the false positive rate of misses
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testPrefilter() {
+    VDetect vdetect(MINPRIME, packedHashCode, DOUBLEHASH);
+    vector<Virus> dataList;
+    bool result = true;
+    for (int i=0;i<6000;i++){
+        dataList.push_back(Virus(i % 2 ? sequencer(21, i) : sequencer(40, i), MINID + i % 9000));
+    }
+    for (int i=0;i<2000;i++){
+        result = result && vdetect.insert(dataList[i]);
+    }
+    vdetect.setPrefilter(true); // built from the entries already there
+    vdetect.setMigrationBudget(16);
+    for (int i=2000;i<6000;i++){
+        result = result && vdetect.insert(dataList[i]);
+        if (i == 4000)
+            vdetect.changeProbPolicy(SWISSTABLE);
+    }
+    for (int i=0;i<6000;i+=5){
+        result = result && vdetect.remove(dataList[i]);
+    }
+    result = result && (vdetect.m_currentFilter != nullptr) && (!vdetect.isRehashing() || vdetect.m_oldFilter != nullptr);
+    for (int i=0;i<6000;i++){
+        bool kept = i % 5 != 0;
+        result = result && ((vdetect.getVirus(dataList[i].getKey(), dataList[i].getID()) == dataList[i]) == kept);
+        result = result && ((vdetect.findKey(dataList[i].getKey()) != nullptr) == kept);
+        const Slot* slot = vdetect.findSlot(PackedKey(dataList[i].getKey()), packedHashCode(dataList[i].getKey()), dataList[i].getID());
+        result = result && ((slot != nullptr) == kept);
+    }
+
+    // keys that were never stored, almost all stop at the filter of the current table
+    vdetect.waitForRehash();
+    int passed = 0;
+    for (int i=0;i<100000;i++){
+        passed += vdetect.m_currentFilter->mayContain(packedHashCode(sequencer(30, i)));
+        result = result && !vdetect.contains(sequencer(30, i), MINID);
+    }
+    result = result && (passed < 1000);
+
+    vdetect.setPrefilter(false);
+    result = result && (vdetect.m_currentFilter == nullptr);
+    for (int i=0;i<6000;i++){
+        result = result && (vdetect.contains(dataList[i].getKey(), dataList[i].getID()) == (i % 5 != 0));
+    }
+    return result;
+}
+
+//Function: Tester::testIdIndex
+//Case: 3000 short, long and raw keys under 12 IDs are inserted with the ID index on from half way,
+// some are removed, the table rehashes and changes policy; test findById and countById against the
+// entries each ID should have, with the index on and with the scan after turning it off
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testIdIndex() {
+    VDetect vdetect(MINPRIME, packedHashCode, QUADRATIC);
+    vector<Virus> dataList;
+    bool result = true;
+    for (int i=0;i<3000;i++){
+        string key = i % 3 == 0 ? sequencer(12, i) : (i % 3 == 1 ? sequencer(45, i) : "raw-" + to_string(i));
+        dataList.push_back(Virus(key, MINID + i % 12));
+        result = result && vdetect.insert(dataList[i]);
+        if (i == 1500)
+            vdetect.setIdIndex(true); // built from what is stored so far
+        if (i == 2000)
+            vdetect.changeProbPolicy(ROBINHOOD);
+    }
+    for (int i=0;i<3000;i+=7){
+        result = result && vdetect.remove(dataList[i]);
+    }
+    result = result && !vdetect.remove(dataList[0]) && !vdetect.insert(dataList[1]); // no change, no list change
+
+    for (int pass=0;pass<2;pass++){
+        for (int id=MINID;id<MINID + 12;id++){
+            vector<string> expected;
+            for (int i=0;i<3000;i++){
+                if (i % 7 != 0 && dataList[i].getID() == id)
+                    expected.push_back(dataList[i].getKey());
+            }
+            vector<string> found;
+            for (const Virus& virus : vdetect.findById(id)){
+                result = result && (virus.getID() == id);
+                found.push_back(virus.getKey());
+            }
+            sort(expected.begin(), expected.end());
+            sort(found.begin(), found.end());
+            result = result && (found == expected) && (vdetect.countById(id) == expected.size());
+        }
+        result = result && vdetect.findById(MINID + 12).empty() && vdetect.findById(MAXID + 1).empty() && (vdetect.countById(MINID - 1) == 0);
+        vdetect.setIdIndex(false); // the second pass scans the tables
+        result = result && vdetect.m_byId.empty();
+    }
+    return result;
+}
+
+//Function: Tester::testFindAll
+//Case: 300 keys get between 1 and 12 IDs each in VDetects of four probing policies and in a GroupedVDetect,
+// then a third of the entries are removed; test findAll of every key against its IDs, the key and
+// entry counts and that overflow lists are reused once groups shrink; then test that a GroupedVDetect
+// with no free slot refuses a new key
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testFindAll() {
+    bool result = true;
+    vector<string> keys;
+    vector<vector<int>> expected;
+    for (int k=0;k<300;k++){
+        keys.push_back(k % 2 ? sequencer(21, k) : sequencer(44, k));
+        expected.push_back(vector<int>());
+        for (int j=0;j<=k % 12;j++)
+            expected[k].push_back(MINID + (k * 31 + j * 97) % 9000);
+    }
+
+    GroupedVDetect grouped(MINPOW2, packedHashCode);
+    vector<VDetect*> tables;
+    // NONE has one slot per key and CUCKOO 2 * BUCKETWAYS plus the stash, too few for 12 IDs
+    for (prob_t policy : {QUADRATIC, DOUBLEHASH, SWISSTABLE, ROBINHOOD})
+        tables.push_back(new VDetect(MINPRIME, packedHashCode, policy));
+    size_t entries = 0;
+    for (int k=0;k<300;k++){
+        for (int id : expected[k]){
+            result = result && grouped.insert(Virus(keys[k], id));
+            for (VDetect* table : tables)
+                result = result && table->insert(Virus(keys[k], id));
+            entries++;
+        }
+    }
+    result = result && !grouped.insert(Virus(keys[0], expected[0][0])) && (grouped.size() == entries) && (grouped.keyCount() == 300);
+    result = result && (sizeof(GroupedVDetect::Group) == 40);
+
+    for (int round=0;round<2;round++){
+        for (int k=0;k<300;k++){
+            vector<int> want = expected[k];
+            sort(want.begin(), want.end());
+            vector<int> got = grouped.findAll(keys[k]);
+            sort(got.begin(), got.end());
+            result = result && (got == want);
+            for (VDetect* table : tables){
+                got = table->findAll(keys[k]);
+                sort(got.begin(), got.end());
+                result = result && (got == want);
+            }
+        }
+        result = result && grouped.findAll(sequencer(21, 5000)).empty() && tables[0]->findAll(sequencer(21, 5000)).empty();
+        if (round == 1)
+            break;
+        size_t spilled = grouped.m_overflow.size();
+        for (int k=0;k<300;k++){ // every third ID of each key, from the front so gaps get filled
+            for (size_t j=0;j<expected[k].size();j+=3){
+                result = result && grouped.remove(Virus(keys[k], expected[k][j]));
+                for (VDetect* table : tables)
+                    result = result && table->remove(Virus(keys[k], expected[k][j]));
+                entries--;
+            }
+            vector<int> kept;
+            for (size_t j=0;j<expected[k].size();j++)
+                if (j % 3 != 0)
+                    kept.push_back(expected[k][j]);
+            expected[k] = kept;
+        }
+        result = result && (grouped.size() == entries) && (grouped.keyCount() == 275); // keys with a single ID are gone
+        // groups are back to at most 8 IDs, the lists they spilled into can be reused
+        result = result && (grouped.m_overflow.size() == spilled) && !grouped.m_freeOverflow.empty();
+        result = result && grouped.insert(Virus(keys[11], MAXID)) && grouped.remove(Virus(keys[11], MAXID));
+    }
+
+    // every slot taken: a new key is refused and not counted, a stored key still takes more IDs
+    GroupedVDetect full(MINPOW2, packedHashCode);
+    result = result && full.insert(Virus(keys[1], MINID));
+    for (size_t i=0;i<full.m_current.cap;i++){
+        if (full.m_current.ctrl[i] < 0)
+            setCtrl(full.m_current.ctrl, full.m_current.cap, i, 0);
+    }
+    result = result && !full.insert(Virus(keys[3], MINID)) && !full.contains(keys[3], MINID) && (full.size() == 1);
+    result = result && full.insert(Virus(keys[1], MAXID)) && (full.size() == 2) && (full.keyCount() == 1);
+    for (VDetect* table : tables)
+        delete table;
+    return result;
+}
+
+//Function: Tester::testHammingLookup
+//Case: random 21-mers and 40-mers, some sharing a key, are stored with Hamming indexes of distance
+// 2 and 1; queries are stored keys with 0 to 3 bases changed; test findNear through the indexes and
+// through the table scan against comparing every stored key, also after removals
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testHammingLookup() {
+    bool result = true;
+    Random base(0, 3);
+    Random pick(0, 599);
+    VDetect vdetect(MINPRIME, packedHashCode, SWISSTABLE);
+    vector<Virus> dataList;
+    for (int i=0;i<600;i++){
+        string key;
+        for (int j=0;j<(i % 2 ? 21 : 40);j++)
+            key += ALPHA[base.getRandNum()];
+        if (i % 10 == 9) // a second ID for an earlier key, and a key one base away from it
+            key = dataList[i - 2].getKey();
+        dataList.push_back(Virus(key, MINID + i));
+        result = result && vdetect.insert(dataList.back());
+        if (i % 10 == 5){
+            key[3] = key[3] == 'A' ? 'C' : 'A';
+            dataList.push_back(Virus(key, MAXID - i));
+            result = result && vdetect.insert(dataList.back());
+        }
+    }
+    result = result && (hammingDistance(PackedKey("ACGTACGT"), PackedKey("ACGAACTT")) == 2);
+
+    // what findNear must return, by comparing the strings
+    auto expected = [&](const string& query, unsigned int distance) {
+        vector<string> near;
+        for (const Virus& virus : dataList){
+            if (virus.getKey().size() != query.size() || !vdetect.contains(virus.getKey(), virus.getID()))
+                continue;
+            unsigned int differ = 0;
+            for (size_t j=0;j<query.size();j++)
+                differ += virus.getKey()[j] != query[j];
+            if (differ <= distance)
+                near.push_back(virus.getKey() + "/" + to_string(virus.getID()));
+        }
+        sort(near.begin(), near.end());
+        return near;
+    };
+    auto check = [&]() {
+        for (int q=0;q<300;q++){
+            string query = dataList[pick.getRandNum()].getKey();
+            for (int change=0;change<q % 4;change++){
+                size_t at = (q * 7 + change * 13) % query.size();
+                query[at] = ALPHA[(baseCode(query[at]) + 1 + change) % 4];
+            }
+            for (unsigned int distance : {0u, 1u, 2u}){
+                vector<string> found;
+                for (const Virus& virus : vdetect.findNear(query, distance))
+                    found.push_back(virus.getKey() + "/" + to_string(virus.getID()));
+                sort(found.begin(), found.end());
+                result = result && (found == expected(query, distance));
+            }
+        }
+    };
+
+    check(); // table scan
+    vdetect.setHammingIndex(21, 2);
+    result = result && (vdetect.m_hamming->maxDistance() == 2);
+    check();
+    for (size_t i=0;i<dataList.size();i+=4){
+        result = result && vdetect.remove(dataList[i]);
+    }
+    check();
+    vdetect.setHammingIndex(40, 1); // 40-mers up to one mismatch through the index, two by scanning
+    check();
+    result = result && vdetect.findNear("ACGTN", 1).empty();
+    vdetect.setHammingIndex(0, 0);
+    result = result && (vdetect.m_hamming == nullptr);
+    return result;
+}
+
+//Function: Tester::testLiveIteration
+//Case: for every probing policy, random inserts and removes are run with checks in between, some of
+// them during a rehash; the occupancy bits are compared to the control bytes, and the entries the
+// iterators and forEachParallel visit are compared to the entries the object contains
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testLiveIteration() {
+    bool result = true;
+    Random RndID(MINID,MAXID);
+    Random RndKey(0,3);
+    for (prob_t policy : {NONE, QUADRATIC, DOUBLEHASH, SWISSTABLE, ROBINHOOD, CUCKOO}){
+        VDetect vdetect(MINPRIME, hashCode, policy);
+        vector<Virus> dataList;
+        auto bitsMatch = [&](const ctrl_t* ctrl, const uint64_t* occupied, size_t cap) {
+            bool match = true;
+            for (size_t i = 0; i < (cap + 63) / 64 * 64; i++){
+                bool live = i < cap && ctrl[i] >= 0;
+                match = match && (live == bool((occupied[i / 64] >> (i % 64)) & 1));
+            }
+            return match;
+        };
+        auto check = [&]() {
+            result = result && bitsMatch(vdetect.m_currentCtrl, vdetect.m_currentOccupied, vdetect.m_currentCap);
+            if (vdetect.m_oldTable != nullptr)
+                result = result && bitsMatch(vdetect.m_oldCtrl, vdetect.m_oldOccupied, vdetect.m_oldCap);
+
+            vector<pair<string, int>> expected;
+            for (const Virus& virus : dataList){
+                if (vdetect.contains(virus.getKey(), virus.getID()))
+                    expected.push_back(make_pair(virus.getKey(), virus.getID()));
+            }
+            vector<pair<string, int>> iterated;
+            for (const Slot& slot : vdetect)
+                iterated.push_back(make_pair(slot.toVirus().getKey(), slot.getID()));
+            vector<pair<string, int>> visited;
+            mutex visitLock;
+            vdetect.forEachParallel([&](const Slot& slot) {
+                lock_guard<mutex> guard(visitLock);
+                visited.push_back(make_pair(slot.toVirus().getKey(), slot.getID()));
+            }, 4);
+            result = result && (iterated.size() == vdetect.liveCount());
+            sort(expected.begin(), expected.end());
+            sort(iterated.begin(), iterated.end());
+            sort(visited.begin(), visited.end());
+            result = result && (iterated == expected) && (visited == expected);
+        };
+
+        check(); // nothing to visit
+        result = result && (vdetect.begin() == vdetect.end());
+        for (int i=0;i<3000;i++){
+            string key;
+            for (int j=0;j<10;j++)
+                key += ALPHA[RndKey.getRandNum()];
+            dataList.push_back(Virus(key, RndID.getRandNum()));
+            vdetect.insert(dataList.back());
+            if (i % 3 == 2)
+                vdetect.remove(dataList[i - 1]);
+            if (i % 500 == 0)
+                check();
+        }
+        check();
+        for (size_t i=0;i<dataList.size();i+=2){
+            vdetect.remove(dataList[i]);
+        }
+        check();
+        vdetect.waitForRehash();
+        check();
+    }
+    return result;
+}
+
+//Function: Tester::testOperationStats
+//Case: inserts, duplicate and out of range inserts, removes, lookups from several threads and a full
+// rehash are run against a QUADRATIC and a NONE object; the memory figures are checked against the
+// tables in every build, the counters only when built with VDETECT_STATS
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testOperationStats() {
+    bool result = true;
+    Random RndKey(0,3);
+    VDetect vdetect(MINPRIME, hashCode, QUADRATIC);
+    vdetect.setIdIndex(true);
+    vector<Virus> dataList;
+    for (int i=0;i<2000;i++){
+        string key;
+        for (int j=0;j<(i % 5 == 0 ? 40 : 12);j++) // some keys go to the arenas
+            key += ALPHA[RndKey.getRandNum()];
+        dataList.push_back(Virus(key, MINID + i));
+        result = result && vdetect.insert(dataList.back());
+    }
+    result = result && !vdetect.insert(dataList[7]) && !vdetect.insert(Virus("ACGT", MAXID + 1));
+    for (int i=0;i<500;i++){
+        result = result && vdetect.remove(dataList[i]);
+    }
+    result = result && !vdetect.remove(dataList[0]);
+
+    auto checkMemory = [&](const VDetectStats& stats) {
+        size_t tables = vdetect.m_currentCap + (vdetect.m_oldTable != nullptr ? vdetect.m_oldCap : 0);
+        size_t parts = stats.objectBytes + stats.tableBytes + stats.ctrlBytes + stats.occupancyBytes +
+                       stats.arenaBytes + stats.keyBytes + stats.filterBytes + stats.idIndexBytes;
+        return stats.tableBytes == tables * sizeof(Slot) && stats.ctrlBytes >= tables &&
+               stats.occupancyBytes * 8 >= tables && stats.arenaBytes > 0 && stats.idIndexBytes > 0 &&
+               stats.totalBytes == parts && stats.currentCap == vdetect.m_currentCap &&
+               stats.currentLive + stats.oldLive + stats.stashSize == vdetect.liveCount() &&
+               stats.migrationProgress >= 0 && stats.migrationProgress <= 1;
+    };
+    result = result && checkMemory(vdetect.stats());
+    vdetect.waitForRehash();
+
+    // lookups from several threads, each one counts into its own counters
+    vector<thread> readers;
+    atomic<int> found(0);
+    for (int t=0;t<4;t++){
+        readers.push_back(thread([&]() {
+            for (size_t i=0;i<dataList.size();i++)
+                found += vdetect.contains(dataList[i].getKey(), dataList[i].getID());
+        }));
+    }
+    for (thread& reader : readers)
+        reader.join();
+    result = result && (found == 4 * 1500);
+
+    VDetectStats stats = vdetect.stats();
+    result = result && checkMemory(stats) && stats.oldCap == 0 && stats.migrationProgress == 1;
+#ifdef VDETECT_STATS
+    uint64_t probes = 0;
+    for (int i=0;i<PROBEBUCKETS;i++)
+        probes += stats.currentProbes[i] + stats.oldProbes[i];
+    result = result && stats.enabled && stats.inserts == 2000 && stats.insertsRejected == 2;
+    result = result && stats.removes == 500 && stats.removeMisses == 1;
+    result = result && stats.lookups == 4 * 2000 && stats.lookupMisses == 4 * 500;
+    // every insert, remove and lookup probed the current table at least once
+    result = result && probes >= 2000 + 501 + 4 * 2000;
+    result = result && stats.rehashesStarted > 0 && stats.rehashesFinished == stats.rehashesStarted;
+    result = result && stats.entriesMigrated > 0 && stats.rehashNanos >= stats.lastRehashNanos;
+
+    // NONE has one slot per hash, a collision goes to the stash or is lost
+    VDetect single(MINPRIME, hashCode, NONE);
+    uint64_t accepted = 0;
+    for (int i=0;i<200;i++)
+        accepted += single.insert(dataList[i]);
+    VDetectStats singleStats = single.stats();
+    result = result && singleStats.probeFailures > 0;
+    result = result && singleStats.probeFailures == singleStats.stashed + singleStats.dropped;
+    // a lost entry is not counted as inserted, insert returned false for it
+    result = result && singleStats.inserts == accepted && accepted + singleStats.dropped >= 200;
+    result = result && stats.inserts == 2000; // separate counters
+#else
+    result = result && !stats.enabled && stats.inserts == 0 && stats.lookups == 0;
+#endif
+    return result;
+}
+
+//Function: Tester::testStashOverflow
+//Case: a NONE table gets 2000 random keys under the textbook hash, so many of them collide; a CUCKOO
+// table gets 20 IDs of one key, more than its two buckets and the stash hold; the ID index is on
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testStashOverflow() {
+    bool result = true;
+    VDetect single(MINPRIME, hashCode, NONE);
+    single.setIdIndex(true);
+    vector<Virus> dataList;
+    vector<bool> stored;
+    for (int i=0;i<2000;i++){
+        dataList.push_back(Virus(sequencer(12, i), MINID + i));
+        stored.push_back(single.insert(dataList[i]));
+    }
+    size_t kept = 0;
+    for (int i=0;i<2000;i++){ // insert returns true exactly for the entries that are there
+        result = result && (single.contains(dataList[i].getKey(), dataList[i].getID()) == stored[i]);
+        result = result && (single.countById(dataList[i].getID()) == size_t(stored[i]));
+        kept += stored[i];
+    }
+    result = result && (kept == single.liveCount()) && (kept > 1500);
+
+    VDetect cuckoo(MINPRIME, hashCode, CUCKOO);
+    cuckoo.setIdIndex(true);
+    int accepted = 0;
+    for (int i=0;i<20;i++){
+        accepted += cuckoo.insert(Virus("ACGTACGT", MINID + i));
+    }
+    cuckoo.waitForRehash();
+    size_t cap = cuckoo.m_currentCap;
+    result = result && (accepted == 2 * BUCKETWAYS + STASHSIZE) && (cuckoo.findAll("ACGTACGT").size() == size_t(accepted));
+    for (int i=0;i<accepted;i++){
+        result = result && cuckoo.contains("ACGTACGT", MINID + i) && (cuckoo.countById(MINID + i) == 1);
+    }
+    for (int i=accepted;i<20;i++){
+        result = result && (cuckoo.countById(MINID + i) == 0);
+    }
+    // a full stash does not start a rehash on every operation
+    for (int i=0;i<100;i++){
+        result = result && !cuckoo.insert(Virus("ACGTACGT", MINID + 100 + i));
+        result = result && !cuckoo.isRehashing();
+    }
+    result = result && (cuckoo.m_currentCap == cap);
+    // a removed ID makes room again
+    result = result && cuckoo.remove(Virus("ACGTACGT", MINID));
+    result = result && cuckoo.insert(Virus("ACGTACGT", MAXID));
+    return result;
+}
+
+//Function: Tester::testPrefilterChurn
+//Case: robin hood and cuckoo tables with a prefilter hold 2000 entries while 100000 of them are
+// removed and replaced by new keys, which never rehashes; test every live entry and that the
+// filter still stops almost every key that was never stored
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testPrefilterChurn() {
+    bool result = true;
+    prob_t policies[] = {ROBINHOOD, CUCKOO};
+    for (prob_t policy : policies){
+        VDetect vdetect(MINPOW2, packedHashCode, policy, POW2CAP);
+        vdetect.setPrefilter(true);
+        for (int i=0;i<2000;i++){
+            result = result && vdetect.insert(Virus(sequencer(30, i), MINID + i % 9000));
+        }
+        vdetect.waitForRehash();
+        size_t cap = vdetect.m_currentCap;
+        for (int i=2000;i<102000;i++){
+            result = result && vdetect.remove(Virus(sequencer(30, i - 2000), MINID + (i - 2000) % 9000));
+            result = result && vdetect.insert(Virus(sequencer(30, i), MINID + i % 9000));
+        }
+        result = result && (vdetect.m_currentCap == cap) && (vdetect.liveCount() == 2000);
+        for (int i=100000;i<102000;i++){
+            result = result && vdetect.contains(sequencer(30, i), MINID + i % 9000);
+        }
+        int passed = 0;
+        for (int i=0;i<20000;i++){
+            passed += vdetect.m_currentFilter->mayContain(packedHashCode(sequencer(31, i)));
+        }
+        result = result && (passed < 1000); // under 5%, without rebuilds every key passes
+    }
+    return result;
+}
@@ -0,0 +1,262 @@
+#include "mappedvdetect.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// next multiple of 8 at or above bytes
+static uint64_t align8(uint64_t bytes){
+    return (bytes + 7) & ~uint64_t(7);
+}
+
+// the file form of a live slot, long keys are appended to arena
+static SnapshotSlot toSnapshot(const Slot& slot, unsigned int hash, vector<uint64_t>& arena){
+    SnapshotSlot saved;
+    memset(&saved, 0, sizeof(saved));
+    const PackedKey& key = slot.getKey();
+    saved.length = key.length();
+    saved.kind = key.isDna() ? DNAPACKED : RAWPACKED;
+    saved.id = slot.getID();
+    saved.hash = hash;
+    if (key.wordCount() <= 1) {
+        saved.word = key.wordCount() == 1 ? key.words()[0] : 0;
+    } else {
+        saved.word = arena.size();
+        arena.insert(arena.end(), key.words(), key.words() + key.wordCount());
+    }
+    return saved;
+}
+
+bool writeAll(int fd, const char* bytes, size_t length){
+    while (length > 0) {
+        ssize_t written = ::write(fd, bytes, length);
+        if (written < 0 && errno != EINTR)
+            return false;
+        if (written > 0) {
+            bytes += written;
+            length -= written;
+        }
+    }
+    return true;
+}
+
+// fsyncs the directory path is in, which makes a rename onto path durable
+static bool syncParent(const string& path){
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+MappedVDetect::MappedVDetect()
+    : m_base(nullptr), m_length(0), m_header(nullptr), m_ctrl(nullptr), m_slots(nullptr),
+      m_stash(nullptr), m_arena(nullptr), m_hash(nullptr) {}
+
+MappedVDetect::~MappedVDetect(){
+    close();
+}
+
+bool MappedVDetect::save(VDetect& vdetect, const string& path){
+    vdetect.waitForRehash();
+    unique_lock<mutex> guard = vdetect.lockTables();
+    return write(vdetect, path);
+}
+
+bool MappedVDetect::write(VDetect& vdetect, const string& path){
+    if (vdetect.m_oldTable != nullptr) // a writer started another rehash after the wait
+        vdetect.migrate(vdetect.m_oldSize);
+
+    size_t cap = vdetect.m_currentCap;
+    vector<SnapshotSlot> slots(cap);
+    vector<SnapshotSlot> stash;
+    vector<uint64_t> arena;
+    memset(slots.data(), 0, cap * sizeof(SnapshotSlot));
+    for (size_t i = 0; i < cap; i++) {
+        if (vdetect.m_currentCtrl[i] >= 0)
+            slots[i] = toSnapshot(vdetect.m_currentTable[i], vdetect.m_currentTable[i].m_hash, arena);
+    }
+    for (size_t i = 0; i < vdetect.m_stashSize; i++)
+        stash.push_back(toSnapshot(vdetect.m_stash[i], vdetect.m_stash[i].m_hash, arena));
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOTMAGIC, sizeof(header.magic));
+    header.version = SNAPSHOTVERSION;
+    header.probing = vdetect.m_currProbing;
+    header.capMode = vdetect.m_capMode;
+    header.hashId = vdetect.m_hash == packedHashCode ? HASHPACKED : HASHCUSTOM;
+    header.cap = cap;
+    header.live = vdetect.liveCount();
+    header.stashCount = stash.size();
+    header.arenaWords = arena.size();
+    header.ctrlOffset = align8(sizeof(header));
+    header.slotOffset = align8(header.ctrlOffset + cap + GROUPWIDTH - 1);
+    header.stashOffset = header.slotOffset + cap * sizeof(SnapshotSlot);
+    header.arenaOffset = header.stashOffset + stash.size() * sizeof(SnapshotSlot);
+
+    // the new file is written next to path and renamed over it, so a process that still has the
+    // old file mapped keeps reading the old pages and a crash leaves either the old or the new file
+    string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    static const char padding[8] = {0};
+    bool written = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+        writeAll(fd, padding, header.ctrlOffset - sizeof(header)) &&
+        writeAll(fd, reinterpret_cast<const char*>(vdetect.m_currentCtrl), cap + GROUPWIDTH - 1) &&
+        writeAll(fd, padding, header.slotOffset - (header.ctrlOffset + cap + GROUPWIDTH - 1)) &&
+        writeAll(fd, reinterpret_cast<const char*>(slots.data()), cap * sizeof(SnapshotSlot)) &&
+        writeAll(fd, reinterpret_cast<const char*>(stash.data()), stash.size() * sizeof(SnapshotSlot)) &&
+        writeAll(fd, reinterpret_cast<const char*>(arena.data()), arena.size() * sizeof(uint64_t)) &&
+        fsync(fd) == 0;
+    written = ::close(fd) == 0 && written;
+    if (!written || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return syncParent(path);
+}
+
+bool MappedVDetect::open(const string& path, hash_fn hash){
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file open
+    if (base == MAP_FAILED)
+        return false;
+    m_base = static_cast<const char*>(base);
+    m_length = info.st_size;
+    m_header = reinterpret_cast<const SnapshotHeader*>(m_base);
+
+    const SnapshotHeader& header = *m_header;
+    bool valid = memcmp(header.magic, SNAPSHOTMAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == SNAPSHOTVERSION &&
+                 header.probing <= CUCKOO && header.capMode <= POW2CAP &&
+                 header.cap >= (header.probing == CUCKOO ? size_t(BUCKETWAYS) : 1) && header.cap <= m_length &&
+                 (header.capMode != POW2CAP || (header.cap >= MINPOW2 && (header.cap & (header.cap - 1)) == 0)) &&
+                 header.stashCount <= STASHSIZE && header.arenaWords <= m_length &&
+                 header.ctrlOffset >= sizeof(SnapshotHeader) && header.ctrlOffset <= m_length &&
+                 header.slotOffset % 8 == 0 &&
+                 header.ctrlOffset + header.cap + GROUPWIDTH - 1 <= header.slotOffset &&
+                 header.slotOffset + header.cap * sizeof(SnapshotSlot) == header.stashOffset &&
+                 header.stashOffset + header.stashCount * sizeof(SnapshotSlot) == header.arenaOffset &&
+                 header.arenaOffset + header.arenaWords * sizeof(uint64_t) == m_length;
+    // the hash decides every probe sequence, a packed snapshot only works with packedHashCode
+    valid = valid && (header.hashId == HASHPACKED) == (hash == packedHashCode);
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    m_ctrl = reinterpret_cast<const ctrl_t*>(m_base + header.ctrlOffset);
+    m_slots = reinterpret_cast<const SnapshotSlot*>(m_base + header.slotOffset);
+    m_stash = reinterpret_cast<const SnapshotSlot*>(m_base + header.stashOffset);
+    m_arena = reinterpret_cast<const uint64_t*>(m_base + header.arenaOffset);
+    m_hash = hash;
+    // keyOf trusts the lengths and arena ranges of the slots, so every live one is checked here
+    for (size_t i = 0; valid && i < header.cap; i++)
+        valid = m_ctrl[i] < 0 || validSlot(m_slots[i]);
+    for (size_t i = 0; valid && i < header.stashCount; i++)
+        valid = validSlot(m_stash[i]);
+    if (!valid)
+        close();
+    return valid;
+}
+
+void MappedVDetect::close(){
+    if (m_base != nullptr)
+        munmap(const_cast<char*>(m_base), m_length);
+    m_base = nullptr;
+    m_length = 0;
+    m_header = nullptr;
+    m_ctrl = nullptr;
+    m_slots = nullptr;
+    m_stash = nullptr;
+    m_arena = nullptr;
+}
+
+Virus MappedVDetect::getVirus(const string& key, int id) const{
+    if (contains(key, id))
+        return Virus(key, id);
+    return EMPTY;
+}
+
+bool MappedVDetect::contains(string_view key, int id) const{
+    if (m_base == nullptr)
+        return false;
+    PackedKey packed(key);
+    unsigned int hash = hashKey(key, packed);
+    size_t index = withPolicy(prob_t(m_header->probing), cap_t(m_header->capMode), [&](auto policy) {
+        typedef decltype(policy) P;
+        return probeFind<typename P::Probe, P::mode>(m_slots, m_ctrl, m_header->cap, hash,
+            [&](const SnapshotSlot& slot) {return matches(slot, packed, hash, id);});
+    });
+    if (index != NOSLOT)
+        return true;
+    for (size_t i = 0; i < m_header->stashCount; i++) {
+        if (matches(m_stash[i], packed, hash, id))
+            return true;
+    }
+    return false;
+}
+
+size_t MappedVDetect::size() const{
+    return m_base == nullptr ? 0 : m_header->live;
+}
+
+bool MappedVDetect::restore(VDetect& vdetect) const{
+    if (m_base == nullptr || vdetect.m_hash != m_hash)
+        return false;
+    unique_lock<mutex> guard = vdetect.lockTables();
+    for (size_t i = 0; i < m_header->cap; i++) {
+        if (m_ctrl[i] >= 0) // the stored hash is reused, hash_fn is not called again
+            vdetect.insertPacked(keyOf(m_slots[i]), m_slots[i].hash, m_slots[i].id);
+    }
+    for (size_t i = 0; i < m_header->stashCount; i++)
+        vdetect.insertPacked(keyOf(m_stash[i]), m_stash[i].hash, m_stash[i].id);
+    return true;
+}
+
+bool MappedVDetect::validSlot(const SnapshotSlot& slot) const{
+    if (slot.kind != DNAPACKED && slot.kind != RAWPACKED)
+        return false;
+    uint64_t perWord = slot.kind == DNAPACKED ? WORDBASES : WORDBYTES; // wordsFor wraps near 2^32
+    uint64_t count = (uint64_t(slot.length) + perWord - 1) / perWord;
+    return count <= 1 || (slot.word <= m_header->arenaWords && count <= m_header->arenaWords - slot.word);
+}
+
+PackedKey MappedVDetect::keyOf(const SnapshotSlot& slot) const{
+    unsigned int count = PackedKey::wordsFor(slot.length, pack_t(slot.kind));
+    const uint64_t* words = count <= 1 ? &slot.word : m_arena + slot.word;
+    return PackedKey::fromWords(words, slot.length, pack_t(slot.kind));
+}
+
+bool MappedVDetect::matches(const SnapshotSlot& slot, const PackedKey& key, unsigned int hash, int id) const{
+    if (slot.hash != hash || slot.id != id || slot.length != key.length() ||
+        slot.kind != (key.isDna() ? DNAPACKED : RAWPACKED))
+        return false;
+    if (key.wordCount() <= 1)
+        return slot.word == (key.wordCount() == 1 ? key.words()[0] : 0);
+    return slot.word + key.wordCount() <= m_header->arenaWords &&
+           memcmp(m_arena + slot.word, key.words(), key.wordCount() * sizeof(uint64_t)) == 0;
+}
+
+unsigned int MappedVDetect::hashKey(string_view key, const PackedKey& packed) const{
+    if (m_hash == packedHashCode)
+        return packed.hash();
+    return m_hash(string(key));
+}
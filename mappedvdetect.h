@@ -0,0 +1,86 @@
+#ifndef MAPPEDVDETECT_H
+#define MAPPEDVDETECT_H
+#include "vdetect.h"
+const char SNAPSHOTMAGIC[8] = {'V', 'D', 'E', 'T', 'E', 'C', 'T', '\0'};
+const uint32_t SNAPSHOTVERSION = 1;
+enum hashid_t {HASHCUSTOM, HASHPACKED};    // hash_fn a snapshot was built with
+
+// snapshot file layout, every section starts on an 8 byte boundary:
+// header, control bytes (cap + GROUPWIDTH - 1), slots (cap), stash slots, key arena words
+struct SnapshotHeader{
+    char     magic[8];
+    uint32_t version;
+    uint32_t probing;       // prob_t of the table
+    uint32_t capMode;       // cap_t of the table
+    uint32_t hashId;        // hashid_t, a custom hash_fn is trusted to be the same one
+    uint64_t cap;
+    uint64_t live;          // live entries, stash included
+    uint64_t stashCount;
+    uint64_t arenaWords;
+    uint64_t ctrlOffset;    // byte offsets of the sections from the start of the file
+    uint64_t slotOffset;
+    uint64_t stashOffset;
+    uint64_t arenaOffset;
+};
+
+// a slot as it is stored in the file, word is the key itself for keys of one word
+// and the index of the key's first arena word otherwise
+struct SnapshotSlot{
+    uint64_t word;
+    uint32_t length;
+    uint8_t  kind;
+    uint8_t  pad[3];
+    int32_t  id;            // 0 for EMPTY and DELETED slots
+    uint32_t hash;
+};
+
+// read-only VDetect served straight from a memory-mapped snapshot file: open maps the file and
+// checks the header, lookups probe the mapped control bytes and slots, nothing is deserialized.
+// Processes that open the same file share its pages in the page cache.
+class MappedVDetect{
+public:
+    friend class Grader;
+    friend class Tester;
+    friend class Journal;
+    MappedVDetect();
+    ~MappedVDetect();
+    MappedVDetect(const MappedVDetect&) = delete;
+    MappedVDetect& operator=(const MappedVDetect&) = delete;
+    // writes vdetect to path, a running rehash is finished first so the file holds one table;
+    // the file is replaced by a rename, so mappings of the previous file stay valid
+    static bool save(VDetect& vdetect, const string& path);
+    // maps path, false if it is not a snapshot of this version or was built with another hash
+    bool open(const string& path, hash_fn hash);
+    void close();
+    bool isOpen() const {return m_base != nullptr;}
+    Virus getVirus(const string& key, int id) const;
+    bool contains(string_view key, int id) const;
+    // number of live entries
+    size_t size() const;
+    // inserts every entry into vdetect, the starting point a journal is replayed on;
+    // false when vdetect uses another hash than the one the snapshot was opened with
+    bool restore(VDetect& vdetect) const;
+
+private:
+    const char*           m_base;   // start of the mapping, nullptr when closed
+    size_t                m_length; // bytes mapped
+    const SnapshotHeader* m_header;
+    const ctrl_t*         m_ctrl;
+    const SnapshotSlot*   m_slots;
+    const SnapshotSlot*   m_stash;
+    const uint64_t*       m_arena;
+    hash_fn               m_hash;
+
+    // the slot's key kind is known and its arena words lie inside the arena
+    bool validSlot(const SnapshotSlot& slot) const;
+    PackedKey keyOf(const SnapshotSlot& slot) const;
+    // save without the wait, the caller holds the table lock of vdetect
+    static bool write(VDetect& vdetect, const string& path);
+    bool matches(const SnapshotSlot& slot, const PackedKey& key, unsigned int hash, int id) const;
+    unsigned int hashKey(string_view key, const PackedKey& packed) const;
+};
+
+// writes all of length bytes to fd, retrying short writes and writes interrupted by a signal;
+// snapshots and the journal both write through it
+bool writeAll(int fd, const char* bytes, size_t length);
+#endif
@@ -0,0 +1,59 @@
+#include "opstats.h"
+#include <unordered_map>
+
+static atomic<uint64_t> nextRegistryId(1);
+
+StatsRegistry::StatsRegistry() : m_id(nextRegistryId++) {}
+
+StatCounters& StatsRegistry::local(){
+    // the last registry a thread counted for, then every registry it ever counted for
+    thread_local uint64_t cachedId = 0;
+    thread_local StatCounters* cached = nullptr;
+    thread_local unordered_map<uint64_t, StatCounters*> blocks;
+    if (cachedId == m_id)
+        return *cached;
+    auto found = blocks.find(m_id);
+    if (found == blocks.end()) {
+        StatCounters* block = new StatCounters();
+        for (int i = 0; i < STATCOUNT; i++)
+            block->counts[i].store(0, memory_order_relaxed);
+        for (int t = 0; t < 2; t++) {
+            for (int i = 0; i < PROBEBUCKETS; i++)
+                block->probes[t][i].store(0, memory_order_relaxed);
+        }
+        {
+            lock_guard<mutex> guard(m_lock);
+            m_blocks.push_back(unique_ptr<StatCounters>(block));
+        }
+        found = blocks.emplace(m_id, block).first;
+    }
+    cachedId = m_id;
+    cached = found->second;
+    return *cached;
+}
+
+void StatsRegistry::collect(VDetectStats& stats) const{
+    uint64_t counts[STATCOUNT] = {0};
+    lock_guard<mutex> guard(m_lock);
+    for (const unique_ptr<StatCounters>& block : m_blocks) {
+        for (int i = 0; i < STATCOUNT; i++)
+            counts[i] += block->counts[i].load(memory_order_relaxed);
+        for (int i = 0; i < PROBEBUCKETS; i++) {
+            stats.currentProbes[i] += block->probes[0][i].load(memory_order_relaxed);
+            stats.oldProbes[i] += block->probes[1][i].load(memory_order_relaxed);
+        }
+    }
+    stats.inserts += counts[STATINSERT];
+    stats.insertsRejected += counts[STATINSERTREJECTED];
+    stats.removes += counts[STATREMOVE];
+    stats.removeMisses += counts[STATREMOVEMISS];
+    stats.lookups += counts[STATLOOKUP];
+    stats.lookupMisses += counts[STATLOOKUPMISS];
+    stats.probeFailures += counts[STATPROBEFAIL];
+    stats.stashed += counts[STATSTASHED];
+    stats.dropped += counts[STATDROPPED];
+    stats.rehashesStarted += counts[STATREHASHSTART];
+    stats.rehashesFinished += counts[STATREHASHEND];
+    stats.entriesMigrated += counts[STATMIGRATED];
+    stats.rehashNanos += counts[STATREHASHNANOS];
+}
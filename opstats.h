@@ -0,0 +1,97 @@
+#ifndef OPSTATS_H
+#define OPSTATS_H
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+const int PROBEBUCKETS = 16;    // probe length histogram buckets, the last one counts longer probes too
+
+// operation counters of a VDetect built with VDETECT_STATS
+enum stat_t {STATINSERT, STATINSERTREJECTED, STATREMOVE, STATREMOVEMISS, STATLOOKUP, STATLOOKUPMISS,
+             STATPROBEFAIL, STATSTASHED, STATDROPPED, STATREHASHSTART, STATREHASHEND, STATMIGRATED,
+             STATREHASHNANOS, STATCOUNT};
+
+// snapshot returned by VDetect::stats(); without VDETECT_STATS the counters stay 0 and only the
+// table state and memory figures, which are read off the tables when the snapshot is taken, are set
+struct VDetectStats{
+    bool     enabled;           // built with VDETECT_STATS
+    // operations
+    uint64_t inserts;           // entries inserted
+    uint64_t insertsRejected;   // duplicates and IDs out of range
+    uint64_t removes;
+    uint64_t removeMisses;
+    uint64_t lookups;           // getVirus, contains, findEntry, findVirus and getVirusBatch queries
+    uint64_t lookupMisses;
+    uint64_t probeFailures;     // inserts whose probe sequence had no free slot (QUADRATIC stops at cap / 2)
+    uint64_t stashed;           // of those, the ones the stash took
+    uint64_t dropped;           // of those, the ones lost to a full stash
+    // key/ID probes, bucket i counts the probes that read i + 1 slots (groups for SWISSTABLE);
+    // current is the table that was current when the probe ran
+    uint64_t currentProbes[PROBEBUCKETS];
+    uint64_t oldProbes[PROBEBUCKETS];
+    // rehashes
+    uint64_t rehashesStarted;
+    uint64_t rehashesFinished;
+    uint64_t entriesMigrated;
+    uint64_t rehashNanos;       // start to the free of the old table, summed over finished rehashes
+    uint64_t lastRehashNanos;
+    // table state
+    size_t   currentCap;
+    size_t   currentLive;
+    size_t   currentDeleted;
+    size_t   oldCap;            // 0 when no rehash is running
+    size_t   oldLive;           // entries still to migrate
+    size_t   stashSize;
+    double   migrationProgress; // old table slots behind the migration cursor, 1 when no rehash is running
+    // memory, in bytes
+    size_t   objectBytes;       // the VDetect itself, stash included
+    size_t   tableBytes;        // slots of both tables
+    size_t   ctrlBytes;         // control bytes of both tables
+    size_t   occupancyBytes;    // occupancy bits of both tables
+    size_t   arenaBytes;        // key arena chunks of both tables
+    size_t   keyBytes;          // words of long keys held outside the arenas (stash)
+    size_t   filterBytes;       // Bloom prefilters
+    size_t   idIndexBytes;      // posting lists of the ID index
+    size_t   totalBytes;        // all of the above, the Hamming index is not counted
+};
+
+// the counters one thread adds to; only that thread writes them, with a relaxed load and store, so an
+// increment costs a plain add and a snapshot can read them from another thread at any time
+struct StatCounters{
+    atomic<uint64_t> counts[STATCOUNT];
+    atomic<uint64_t> probes[2][PROBEBUCKETS];   // current table, old table
+};
+
+// the counters of every thread that used one VDetect. A thread finds its block through a
+// thread_local cache, so counting never takes a lock after the first operation of a thread;
+// blocks belong to the registry and outlive their threads
+class StatsRegistry{
+public:
+    friend class Grader;
+    friend class Tester;
+    StatsRegistry();
+    StatsRegistry(const StatsRegistry&) = delete;
+    StatsRegistry& operator=(const StatsRegistry&) = delete;
+    void count(stat_t stat, uint64_t n = 1) {bump(local().counts[stat], n);}
+    // table is 0 for the current table and 1 for the old one
+    void probe(int table, size_t probes) {
+        bump(local().probes[table][probes < PROBEBUCKETS ? probes - 1 : PROBEBUCKETS - 1], 1);
+    }
+    // adds the counters of every thread into stats
+    void collect(VDetectStats& stats) const;
+
+private:
+    uint64_t m_id;          // never reused, so a cache entry of a deleted registry is never hit
+    mutable mutex m_lock;   // guards m_blocks
+    vector<unique_ptr<StatCounters>> m_blocks;
+
+    static void bump(atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+    // the block of the calling thread, made on its first use
+    StatCounters& local();
+};
+#endif
@@ -0,0 +1,158 @@
+#include "packedkey.h"
+#include <cstring>
+
+static const char BASES[4] = {'A', 'C', 'G', 'T'};    // same order as ALPHA
+
+int baseCode(char base){
+    switch (base) {
+        case 'A': return 0;
+        case 'C': return 1;
+        case 'G': return 2;
+        case 'T': return 3;
+        default:  return -1;
+    }
+}
+
+unsigned int PackedKey::wordsFor(unsigned int length, pack_t kind){
+    if (kind == DNAPACKED)
+        return (length + WORDBASES - 1) / WORDBASES;
+    return (length + WORDBYTES - 1) / WORDBYTES;
+}
+
+PackedKey::PackedKey() : m_word(0), m_length(0), m_kind(DNAPACKED), m_borrowed(false) {}
+
+PackedKey::PackedKey(string_view key) : m_word(0), m_length(key.length()), m_kind(DNAPACKED), m_borrowed(false){
+    for (unsigned int i = 0; i < m_length; i++) { // any character outside ALPHA makes it a raw key
+        if (baseCode(key[i]) < 0) {
+            m_kind = RAWPACKED;
+            break;
+        }
+    }
+
+    unsigned int count = wordCount();
+    uint64_t* dest = &m_word;
+    if (count > 1) {
+        m_words = new uint64_t[count];
+        dest = m_words;
+    }
+
+    if (m_kind == DNAPACKED) {
+        for (unsigned int w = 0; w < count; w++) { // first base of each word ends up in the highest bits
+            uint64_t word = 0;
+            unsigned int end = min(m_length, (w + 1) * WORDBASES);
+            for (unsigned int i = w * WORDBASES; i < end; i++)
+                word = (word << BASEBITS) | uint64_t(baseCode(key[i]));
+            dest[w] = word;
+        }
+    } else {
+        for (unsigned int w = 0; w < count; w++) { // unused bytes of the last word stay zero
+            uint64_t word = 0;
+            unsigned int start = w * WORDBYTES;
+            memcpy(&word, key.data() + start, min(m_length - start, (unsigned int)WORDBYTES));
+            dest[w] = word;
+        }
+    }
+}
+
+// a copy always owns its words, even when rhs borrows them from an arena
+PackedKey::PackedKey(const PackedKey& rhs) : m_word(rhs.m_word), m_length(rhs.m_length), m_kind(rhs.m_kind), m_borrowed(false){
+    if (!rhs.isInline()) {
+        m_words = new uint64_t[rhs.wordCount()];
+        memcpy(m_words, rhs.m_words, rhs.wordCount() * sizeof(uint64_t));
+    }
+}
+
+PackedKey::PackedKey(PackedKey&& rhs) noexcept
+    : m_word(rhs.m_word), m_length(rhs.m_length), m_kind(rhs.m_kind), m_borrowed(rhs.m_borrowed){
+    rhs.m_word = 0; // rhs gives up its buffer and becomes the empty key
+    rhs.m_length = 0;
+    rhs.m_kind = DNAPACKED;
+    rhs.m_borrowed = false;
+}
+
+PackedKey::~PackedKey(){
+    if (ownsWords())
+        delete [] m_words;
+}
+
+PackedKey& PackedKey::operator=(const PackedKey& rhs){
+    if (this != &rhs) {
+        PackedKey copy(rhs);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+PackedKey& PackedKey::operator=(PackedKey&& rhs) noexcept{
+    if (this != &rhs) {
+        if (ownsWords())
+            delete [] m_words;
+        m_word = rhs.m_word;
+        m_length = rhs.m_length;
+        m_kind = rhs.m_kind;
+        m_borrowed = rhs.m_borrowed;
+        rhs.m_word = 0;
+        rhs.m_length = 0;
+        rhs.m_kind = DNAPACKED;
+        rhs.m_borrowed = false;
+    }
+    return *this;
+}
+
+uint64_t* PackedKey::releaseWords(){
+    uint64_t* words = ownsWords() ? m_words : nullptr; // arena words go away with their arena
+    m_word = 0;
+    m_length = 0;
+    m_kind = DNAPACKED;
+    m_borrowed = false;
+    return words;
+}
+
+PackedKey PackedKey::fromWords(const uint64_t* words, unsigned int length, pack_t kind){
+    PackedKey key;
+    key.m_length = length;
+    key.m_kind = kind;
+    unsigned int count = key.wordCount();
+    if (count == 1) {
+        key.m_word = words[0];
+    } else if (count > 1) {
+        key.m_words = new uint64_t[count];
+        memcpy(key.m_words, words, count * sizeof(uint64_t));
+    }
+    return key;
+}
+
+string PackedKey::toString() const{
+    string key(m_length, ' ');
+    const uint64_t* src = words();
+    if (m_kind == DNAPACKED) {
+        for (unsigned int w = 0; w < wordCount(); w++) {
+            unsigned int start = w * WORDBASES;
+            unsigned int count = min(m_length - start, (unsigned int)WORDBASES);
+            for (unsigned int i = 0; i < count; i++) // walk the word from its lowest bits backwards
+                key[start + count - 1 - i] = BASES[(src[w] >> (i * BASEBITS)) & 3];
+        }
+    } else {
+        for (unsigned int w = 0; w < wordCount(); w++) {
+            unsigned int start = w * WORDBYTES;
+            memcpy(&key[start], &src[w], min(m_length - start, (unsigned int)WORDBYTES));
+        }
+    }
+    return key;
+}
+
+unsigned int PackedKey::hash() const{
+    return packedWordsHash(words(), wordCount(), m_length, pack_t(m_kind));
+}
+
+bool operator==(const PackedKey& lhs, const PackedKey& rhs){
+    if (lhs.m_length != rhs.m_length || lhs.m_kind != rhs.m_kind)
+        return false;
+    if (lhs.isInline()) // one word compare for k-mers up to 32 bases
+        return lhs.m_word == rhs.m_word;
+    return memcmp(lhs.m_words, rhs.m_words, lhs.wordCount() * sizeof(uint64_t)) == 0;
+}
+
+unsigned int packedHashCode(string key){
+    return PackedKey(key).hash();
+}
@@ -0,0 +1,88 @@
+#ifndef PACKEDKEY_H
+#define PACKEDKEY_H
+#include <string>
+#include <string_view>
+#include <cstdint>
+using namespace std;
+const int BASEBITS = 2;     // bits used by one nucleotide
+const int WORDBASES = 32;   // nucleotides packed into one 64-bit word
+const int WORDBYTES = 8;    // raw characters stored in one 64-bit word
+const uint64_t GOLDEN = 0x9E3779B97F4A7C15ULL; // 2^64 divided by the golden ratio
+
+enum pack_t {DNAPACKED, RAWPACKED}; // ACGT keys use 2 bits per base, anything else is kept as bytes
+
+class PackedKey{
+public:
+    friend class Grader;
+    friend class Tester;
+    friend class ConcurrentVDetect;
+    friend class KeyArena;
+    friend class KmerScanner;
+    PackedKey();
+    explicit PackedKey(string_view key);
+    PackedKey(const PackedKey& rhs);
+    PackedKey(PackedKey&& rhs) noexcept;
+    ~PackedKey();
+    PackedKey& operator=(const PackedKey& rhs);
+    PackedKey& operator=(PackedKey&& rhs) noexcept;
+    // rebuilds the original string from the packed words
+    string toString() const;
+    // number of bases (or characters for a raw key)
+    unsigned int length() const {return m_length;}
+    bool empty() const {return m_length == 0;}
+    bool isDna() const {return m_kind == DNAPACKED;}
+    // number of 64-bit words used by the key
+    unsigned int wordCount() const {return wordsFor(m_length, pack_t(m_kind));}
+    const uint64_t* words() const {return isInline() ? &m_word : m_words;}
+    // hands the heap words of a long key to the caller and leaves the key empty,
+    // nullptr for an inline key or one that borrows its words from an arena
+    uint64_t* releaseWords();
+    // bytes of heap words the key frees itself, 0 for inline and borrowed keys
+    size_t heapBytes() const {return ownsWords() ? wordCount() * sizeof(uint64_t) : 0;}
+    // hash computed on the packed words, no per-character work
+    unsigned int hash() const;
+    // the key stored in words, as written by words() of a key of that length and kind
+    static PackedKey fromWords(const uint64_t* words, unsigned int length, pack_t kind);
+    // number of 64-bit words a key of length characters uses
+    static unsigned int wordsFor(unsigned int length, pack_t kind);
+    // Overloaded equality operators, compare whole words
+    friend bool operator==(const PackedKey& lhs, const PackedKey& rhs);
+    friend bool operator!=(const PackedKey& lhs, const PackedKey& rhs){return !(lhs == rhs);}
+
+private:
+    union {
+        uint64_t  m_word;   // inline storage, up to 32 bases or 8 characters
+        uint64_t* m_words;  // heap storage for longer keys
+    };
+    uint32_t m_length;      // number of bases or characters
+    uint8_t  m_kind;        // pack_t of the key
+    bool     m_borrowed;    // m_words points into a KeyArena, the key does not free it
+
+    bool isInline() const {return wordCount() <= 1;}
+    bool ownsWords() const {return !isInline() && !m_borrowed;}
+};
+
+// finalizer from MurmurHash3
+inline uint64_t mix64(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// hash of packed words, PackedKey::hash and every fixed length key packed the same way use it,
+// so their hashes agree; a constant count lets the compiler unroll the loop
+inline unsigned int packedWordsHash(const uint64_t* words, unsigned int count, unsigned int length, pack_t kind){
+    uint64_t h = length * GOLDEN + kind;
+    for (unsigned int w = 0; w < count; w++)
+        h = mix64(h ^ words[w]);
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+// returns the 2-bit code of a nucleotide or -1 if it is not in ALPHA
+int baseCode(char base);
+// hash function that works on the packed form of the key, can be passed to VDetect
+unsigned int packedHashCode(string key);
+#endif
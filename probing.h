@@ -0,0 +1,259 @@
+#ifndef PROBING_H
+#define PROBING_H
+#include <cstddef>
+#include <cstdint>
+#include "ctrlgroup.h"
+enum prob_t {NONE, QUADRATIC, DOUBLEHASH, SWISSTABLE, ROBINHOOD, CUCKOO};  // types of collision handling policy
+enum cap_t {PRIMECAP, POW2CAP};                          // how table capacities are chosen
+const size_t NOSLOT = size_t(-1);                         // returned when a probe finds nothing
+const int BUCKETWAYS = 4;                                 // slots of a cuckoo bucket
+
+#ifdef VDETECT_STATS
+inline thread_local size_t lastProbes = 0;  // slots (groups for GroupProbe) the last probeFind of the thread read
+#define PROBED(n) (lastProbes = (n))
+#else
+#define PROBED(n) ((void)0)
+#endif
+
+// first slot of a probe sequence, prime capacities use % once per operation,
+// power of two capacities take the top bits of a multiply (no division at all)
+template <cap_t Mode>
+inline size_t homeSlot(unsigned int hash, size_t cap){
+    if (Mode == POW2CAP)
+        return size_t((uint64_t(hash) * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctzll(cap)));
+    return hash % cap;
+}
+
+// brings pos back into the table, pos is always below 2 * cap
+template <cap_t Mode>
+inline size_t wrapSlot(size_t pos, size_t cap){
+    if (Mode == POW2CAP)
+        return pos & (cap - 1);
+    return pos >= cap ? pos - cap : pos;
+}
+
+// probing policies as types, so the probe loop of a fixed policy is inlined with no branch on prob_t
+// firstStep: distance to the second probe, stepInc: growth of the step, limit: probes before giving up
+struct NoProbe{
+    static const prob_t policy = NONE;
+    static const bool grouped = false;
+    template <cap_t Mode> static size_t firstStep(unsigned int) {return 0;}
+    template <cap_t Mode> static size_t stepInc() {return 0;}
+    template <cap_t Mode> static size_t limit(size_t) {return 1;}
+};
+
+struct QuadraticProbe{
+    static const prob_t policy = QUADRATIC;
+    static const bool grouped = false;
+    // i*i in a prime table, only the first half of its offsets are distinct,
+    // i*(i+1)/2 in a power of two table, which reaches every slot
+    template <cap_t Mode> static size_t firstStep(unsigned int) {return 1;}
+    template <cap_t Mode> static size_t stepInc() {return Mode == PRIMECAP ? 2 : 1;}
+    template <cap_t Mode> static size_t limit(size_t cap) {return Mode == PRIMECAP ? cap / 2 : cap;}
+};
+
+struct DoubleHashProbe{
+    static const prob_t policy = DOUBLEHASH;
+    static const bool grouped = false;
+    // an odd step is coprime with a power of two capacity
+    template <cap_t Mode> static size_t firstStep(unsigned int hash) {
+        return Mode == PRIMECAP ? 11 - (hash % 11) : (11 - (hash % 11)) | 1;
+    }
+    template <cap_t Mode> static size_t stepInc() {return 0;}
+    template <cap_t Mode> static size_t limit(size_t cap) {return cap;}
+};
+
+struct GroupProbe{
+    static const prob_t policy = SWISSTABLE;
+    static const bool grouped = true;
+    template <cap_t Mode> static size_t firstStep(unsigned int) {return GROUPWIDTH;}
+    template <cap_t Mode> static size_t stepInc() {return 0;}
+    template <cap_t Mode> static size_t limit(size_t cap) {return (cap + GROUPWIDTH - 1) / GROUPWIDTH;}
+};
+
+// linear probing, VDetect keeps the Robin Hood order on insert and shifts entries back on remove,
+// so a ROBINHOOD table never holds a DELETED slot and a lookup stops at the first EMPTY one
+struct RobinHoodProbe{
+    static const prob_t policy = ROBINHOOD;
+    static const bool grouped = false;
+    template <cap_t Mode> static size_t firstStep(unsigned int) {return 1;}
+    template <cap_t Mode> static size_t stepInc() {return 0;}
+    template <cap_t Mode> static size_t limit(size_t cap) {return cap;}
+};
+
+// two choice hashing over buckets of BUCKETWAYS slots, a key lives in one of its two buckets,
+// so a lookup reads 2 * BUCKETWAYS control bytes and never follows a chain; every ID of one key has
+// the same buckets, so more than 2 * BUCKETWAYS IDs of a key spill into the stash of VDetect
+struct CuckooProbe{
+    static const prob_t policy = CUCKOO;
+    static const bool grouped = false;
+    template <cap_t Mode> static size_t firstStep(unsigned int) {return 1;}
+    template <cap_t Mode> static size_t stepInc() {return 0;}
+    template <cap_t Mode> static size_t limit(size_t) {return 2 * BUCKETWAYS;}
+};
+
+// hash of the second cuckoo bucket, the murmur3 key mix so it does not follow the first bucket
+inline unsigned int altHash(unsigned int hash){
+    hash *= 0xCC9E2D51u;
+    hash = (hash << 15) | (hash >> 17);
+    hash *= 0x1B873593u;
+    return hash ^ (hash >> 16);
+}
+
+// the two buckets of a hash in a table of cap slots, the cap % BUCKETWAYS slots at the end are unused
+template <cap_t Mode>
+inline void cuckooBuckets(unsigned int hash, size_t cap, size_t& first, size_t& second){
+    size_t buckets = cap / BUCKETWAYS;
+    first = homeSlot<Mode>(hash, buckets);
+    second = homeSlot<Mode>(altHash(hash), buckets);
+    if (second == first) // two different buckets, the key always has somewhere to move
+        second = first + 1 == buckets ? 0 : first + 1;
+}
+
+// distance of pos from the home slot of its entry, counted along the linear probe sequence
+inline size_t probeDistance(size_t home, size_t pos, size_t cap){
+    return pos >= home ? pos - home : pos + cap - home;
+}
+
+// walks the slots a policy tries for one hash, every step is an add and a compare
+// because no step is ever larger than the capacity
+template <class Probe, cap_t Mode>
+class ProbeWalk{
+public:
+    ProbeWalk(unsigned int hash, size_t cap)
+        : m_pos(homeSlot<Mode>(hash, cap)), m_step(Probe::template firstStep<Mode>(hash)),
+          m_probe(0), m_limit(Probe::template limit<Mode>(cap)), m_cap(cap) {}
+    // current slot (first slot of the group for GroupProbe)
+    size_t index() const {return m_pos;}
+    // slots (groups) read so far, the current one included
+    size_t probes() const {return m_probe < m_limit ? m_probe + 1 : m_limit;}
+    // moves to the next slot, returns false once the policy gives up
+    bool next(){
+        if (++m_probe >= m_limit)
+            return false;
+        m_pos = wrapSlot<Mode>(m_pos + m_step, m_cap);
+        m_step += Probe::template stepInc<Mode>();
+        return true;
+    }
+
+private:
+    size_t m_pos;       // slot being probed
+    size_t m_step;      // distance to the next slot
+    size_t m_probe;     // probes made so far
+    size_t m_limit;     // probes allowed by the policy
+    size_t m_cap;       // table capacity
+};
+
+// returns the index of the first live slot on the probe sequence accepted by match or NOSLOT,
+// match only sees slots whose control byte carries the fragment of hash
+template <class Probe, cap_t Mode, class SlotT, class Match>
+inline size_t probeFind(const SlotT* table, const ctrl_t* ctrl, size_t cap, unsigned int hash, Match match){
+    ctrl_t fragment = hashFragment(hash);
+
+    if constexpr (Probe::policy == CUCKOO) { // both buckets are read whole, there is no EMPTY stop
+        size_t buckets[2];
+        cuckooBuckets<Mode>(hash, cap, buckets[0], buckets[1]);
+        for (int b = 0; b < 2; b++) {
+            for (int way = 0; way < BUCKETWAYS; way++) {
+                size_t index = buckets[b] * BUCKETWAYS + way;
+                if (ctrl[index] == fragment && match(table[index])) {
+                    PROBED(b * BUCKETWAYS + way + 1);
+                    return index;
+                }
+            }
+        }
+        PROBED(2 * BUCKETWAYS);
+        return NOSLOT;
+    }
+
+    ProbeWalk<Probe, Mode> walk(hash, cap);
+    if constexpr (Probe::grouped) { // check GROUPWIDTH control bytes at a time
+        do {
+            Group group(ctrl + walk.index());
+            for (uint32_t mask = group.match(fragment); mask != 0; mask &= mask - 1) {
+                size_t index = wrapSlot<Mode>(walk.index() + lowestBit(mask), cap);
+                if (match(table[index])) {
+                    PROBED(walk.probes());
+                    return index;
+                }
+            }
+            if (group.matchEmpty()) // the key would have been placed before an empty slot
+                break;
+        } while (walk.next());
+    } else {
+        do {
+            size_t index = walk.index();
+            if (ctrl[index] == CTRLEMPTY) // nothing was ever stored past this point of the sequence
+                break;
+            if (ctrl[index] == fragment && match(table[index])) {
+                PROBED(walk.probes());
+                return index;
+            }
+        } while (walk.next());
+    }
+    PROBED(walk.probes());
+    return NOSLOT;
+}
+
+// returns the first EMPTY or DELETED slot on the probe sequence or NOSLOT if there is none
+template <class Probe, cap_t Mode>
+inline size_t probeFree(const ctrl_t* ctrl, size_t cap, unsigned int hash){
+    if constexpr (Probe::policy == CUCKOO) { // NOSLOT when both buckets are full, the caller evicts
+        size_t buckets[2];
+        cuckooBuckets<Mode>(hash, cap, buckets[0], buckets[1]);
+        for (int b = 0; b < 2; b++) {
+            for (int way = 0; way < BUCKETWAYS; way++) {
+                if (ctrl[buckets[b] * BUCKETWAYS + way] < 0)
+                    return buckets[b] * BUCKETWAYS + way;
+            }
+        }
+        return NOSLOT;
+    }
+
+    ProbeWalk<Probe, Mode> walk(hash, cap);
+    if constexpr (Probe::grouped) {
+        do {
+            uint32_t mask = Group(ctrl + walk.index()).matchEmptyOrDeleted();
+            if (mask != 0)
+                return wrapSlot<Mode>(walk.index() + lowestBit(mask), cap);
+        } while (walk.next());
+    } else {
+        do {
+            if (ctrl[walk.index()] < 0) // EMPTY or DELETED
+                return walk.index();
+        } while (walk.next());
+    }
+    return NOSLOT;
+}
+
+// a probing policy and a capacity mode fixed at compile time
+template <class P, cap_t M>
+struct ProbePolicy{
+    typedef P Probe;
+    static const cap_t mode = M;
+};
+
+// calls fn with the ProbePolicy of the runtime values, this is the only branch on the policy
+// an operation makes, everything fn does with the policy is resolved at compile time
+template <class Fn>
+inline auto withPolicy(prob_t probing, cap_t mode, Fn fn) -> decltype(fn(ProbePolicy<NoProbe, PRIMECAP>())){
+    if (mode == POW2CAP) {
+        switch (probing) {
+            case QUADRATIC:  return fn(ProbePolicy<QuadraticProbe, POW2CAP>());
+            case DOUBLEHASH: return fn(ProbePolicy<DoubleHashProbe, POW2CAP>());
+            case SWISSTABLE: return fn(ProbePolicy<GroupProbe, POW2CAP>());
+            case ROBINHOOD:  return fn(ProbePolicy<RobinHoodProbe, POW2CAP>());
+            case CUCKOO:     return fn(ProbePolicy<CuckooProbe, POW2CAP>());
+            default:         return fn(ProbePolicy<NoProbe, POW2CAP>());
+        }
+    }
+    switch (probing) {
+        case QUADRATIC:  return fn(ProbePolicy<QuadraticProbe, PRIMECAP>());
+        case DOUBLEHASH: return fn(ProbePolicy<DoubleHashProbe, PRIMECAP>());
+        case SWISSTABLE: return fn(ProbePolicy<GroupProbe, PRIMECAP>());
+        case ROBINHOOD:  return fn(ProbePolicy<RobinHoodProbe, PRIMECAP>());
+        case CUCKOO:     return fn(ProbePolicy<CuckooProbe, PRIMECAP>());
+        default:         return fn(ProbePolicy<NoProbe, PRIMECAP>());
+    }
+}
+#endif
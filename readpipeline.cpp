@@ -0,0 +1,245 @@
+#include "readpipeline.h"
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <unordered_map>
+
+// length of the line starting at pos without its '\r', npos when the line is not complete
+static size_t lineLength(string_view text, size_t pos, size_t& next){
+    size_t end = text.find('\n', pos);
+    if (end == string_view::npos)
+        return string_view::npos;
+    next = end + 1;
+    if (end > pos && text[end - 1] == '\r')
+        end--;
+    return end - pos;
+}
+
+size_t lastRecordEnd(string_view text, bool fastq){
+    if (!fastq) { // a FASTA record ends where the next header starts
+        size_t header = text.rfind("\n>");
+        return header == string_view::npos ? 0 : header + 1;
+    }
+    // FASTQ: header, sequence lines up to '+', then as many quality characters as bases
+    size_t pos = 0;
+    size_t end = 0;
+    while (pos < text.size()) {
+        if (text[pos] == '\n' || text[pos] == '\r') {
+            end = ++pos;
+            continue;
+        }
+        if (text[pos] != '@') // not FASTQ after all, the scanner makes what it can of it
+            return text.size();
+        size_t next;
+        if (lineLength(text, pos, next) == string_view::npos)
+            return end;
+        pos = next;
+        size_t bases = 0;
+        while (pos < text.size() && text[pos] != '+') {
+            size_t length = lineLength(text, pos, next);
+            if (length == string_view::npos)
+                return end;
+            bases += length;
+            pos = next;
+        }
+        if (pos >= text.size() || lineLength(text, pos, next) == string_view::npos)
+            return end;
+        pos = next;
+        size_t quality = 0;
+        while (quality < bases) {
+            size_t length = lineLength(text, pos, next);
+            if (length == string_view::npos)
+                return end;
+            quality += length;
+            pos = next;
+        }
+        end = pos;
+    }
+    return end;
+}
+
+ReadPipeline::ReadPipeline(const VDetect& vdetect, unsigned int k, unsigned int threads, size_t chunk)
+    : m_vdetect(vdetect), m_k(k), m_threads(threads), m_chunk(chunk > 0 ? chunk : PIPECHUNK),
+      m_queues(nullptr), m_queued(0), m_submitted(0), m_inFlight(0), m_closed(false),
+      m_out(nullptr), m_nextOut(0), m_stats{0, 0, 0, 0, 0}{
+    if (m_threads == 0)
+        m_threads = max(1u, thread::hardware_concurrency());
+}
+
+bool ReadPipeline::run(const vector<string>& paths, ostream& out){
+    return process(paths, nullptr, out);
+}
+
+bool ReadPipeline::run(istream& in, ostream& out){
+    return process(vector<string>(), &in, out);
+}
+
+bool ReadPipeline::process(const vector<string>& paths, istream* in, ostream& out){
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<WorkQueue> queues(m_threads);
+    m_queues = &queues;
+    m_queued = 0;
+    m_submitted = 0;
+    m_inFlight = 0;
+    m_closed = false;
+    m_out = &out;
+    m_finished.clear();
+    m_nextOut = 0;
+    m_stats = PipelineStats{0, 0, 0, 0, 0};
+
+    vector<thread> workers;
+    for (unsigned int i = 0; i < m_threads; i++)
+        workers.push_back(thread(&ReadPipeline::work, this, i));
+
+    bool ok = true;
+    if (in != nullptr)
+        ok = feed(*in);
+    for (const string& path : paths) {
+        if (path == "-") {
+            ok = feed(cin) && ok;
+            continue;
+        }
+        ifstream file(path, ios::binary);
+        ok = file && feed(file) && ok;
+    }
+
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_closed = true;
+    }
+    m_ready.notify_all();
+    for (thread& worker : workers)
+        worker.join();
+    m_queues = nullptr;
+    m_stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+bool ReadPipeline::feed(istream& in){
+    string carry;
+    vector<char> block(m_chunk);
+    bool detected = false;
+    bool fastq = false;
+    while (in) {
+        in.read(block.data(), block.size());
+        carry.append(block.data(), in.gcount());
+        if (!detected) {
+            size_t first = carry.find_first_not_of("\r\n");
+            if (first == string::npos)
+                continue;
+            fastq = carry[first] == '@';
+            detected = true;
+        }
+        size_t end = lastRecordEnd(carry, fastq);
+        if (end > 0) {
+            submit(carry.substr(0, end));
+            carry.erase(0, end);
+        }
+    }
+    if (!carry.empty()) // the last record has no header after it
+        submit(std::move(carry));
+    return !in.bad();
+}
+
+void ReadPipeline::submit(string text){
+    size_t index;
+    {
+        unique_lock<mutex> guard(m_lock);
+        m_space.wait(guard, [this]() {return m_inFlight < size_t(m_threads) * CHUNKSPERWORKER;});
+        m_inFlight++;
+        index = m_submitted++;
+    }
+    WorkQueue& queue = (*m_queues)[index % m_threads];
+    {
+        lock_guard<mutex> guard(queue.lock);
+        queue.chunks.push_back(Chunk{index, std::move(text)});
+    }
+    m_queued++;
+    {
+        lock_guard<mutex> guard(m_lock); // a worker between its check and its wait sees the count
+    }
+    m_ready.notify_one();
+}
+
+bool ReadPipeline::takeChunk(unsigned int worker, Chunk& chunk){
+    vector<WorkQueue>& queues = *m_queues;
+    while (true) {
+        for (unsigned int t = 0; t < m_threads; t++) {
+            WorkQueue& queue = queues[(worker + t) % m_threads];
+            lock_guard<mutex> guard(queue.lock);
+            if (queue.chunks.empty())
+                continue;
+            if (t == 0) { // own queue from the front, the oldest chunk is the next one to be written
+                chunk = std::move(queue.chunks.front());
+                queue.chunks.pop_front();
+            } else {      // steal from the back, away from where the owner works
+                chunk = std::move(queue.chunks.back());
+                queue.chunks.pop_back();
+            }
+            m_queued--;
+            return true;
+        }
+        unique_lock<mutex> guard(m_lock);
+        m_ready.wait(guard, [this]() {return m_queued > 0 || m_closed;});
+        if (m_queued == 0 && m_closed)
+            return false;
+    }
+}
+
+void ReadPipeline::work(unsigned int worker){
+    KmerScanner scanner(m_vdetect, m_k);
+    string output;
+    unordered_map<int, size_t> counts;  // hits per ID of the read being scanned
+    size_t readHits = 0;
+    size_t classified = 0;
+    scanner.setReadCallback([&](size_t, const string& name, size_t length) {
+        int best = 0;
+        size_t bestCount = 0;
+        for (const auto& count : counts) { // ties go to the lower ID so every run prints the same
+            if (count.second > bestCount || (count.second == bestCount && count.first < best)) {
+                best = count.first;
+                bestCount = count.second;
+            }
+        }
+        classified += best != 0;
+        output += name;
+        output += '\t' + to_string(best) + '\t' + to_string(readHits) + '\t' + to_string(length) + '\n';
+        counts.clear();
+        readHits = 0;
+    });
+
+    Chunk chunk;
+    while (takeChunk(worker, chunk)) {
+        scanner.reset();
+        output.clear();
+        classified = 0;
+        scanner.scanBuffer(chunk.text, [&](const KmerHit& hit) {
+            counts[hit.id]++;
+            readHits++;
+        });
+        deliver(chunk.index, std::move(output), scanner, classified);
+    }
+}
+
+void ReadPipeline::deliver(size_t index, string output, const KmerScanner& scanner, size_t classified){
+    lock_guard<mutex> guard(m_mergeLock);
+    m_stats.reads += scanner.reads();
+    m_stats.bases += scanner.bases();
+    m_stats.hits += scanner.hits();
+    m_stats.classified += classified;
+    m_finished[index] = std::move(output);
+    size_t written = 0;
+    for (auto next = m_finished.find(m_nextOut); next != m_finished.end(); next = m_finished.find(m_nextOut)) {
+        *m_out << next->second;
+        m_finished.erase(next);
+        m_nextOut++;
+        written++;
+    }
+    if (written > 0) {
+        {
+            lock_guard<mutex> spaceGuard(m_lock);
+            m_inFlight -= written;
+        }
+        m_space.notify_one();
+    }
+}
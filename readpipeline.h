@@ -0,0 +1,87 @@
+#ifndef READPIPELINE_H
+#define READPIPELINE_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "kmerscanner.h"
+using namespace std;
+const size_t PIPECHUNK = 4 << 20;   // bytes of whole records handed to a worker at a time
+const int CHUNKSPERWORKER = 4;      // chunks read ahead per worker, bounds the memory in use
+
+struct PipelineStats{
+    size_t reads;
+    size_t bases;
+    size_t hits;            // stored k-mer windows
+    size_t classified;      // reads with at least one hit
+    double seconds;
+    double basesPerSecond() const {return seconds > 0 ? bases / seconds : 0;}
+};
+
+// classifies the reads of FASTA/FASTQ input on all cores. The calling thread cuts the input into
+// chunks that end on a record boundary, workers take chunks from their own queue and steal from
+// the back of the others' when it runs dry, each scanning with its own KmerScanner against the
+// shared table. Results are written in input order, one line per read:
+//     name <tab> ID with the most hits, 0 if none <tab> hits <tab> bases
+// The table is only read: it must not change during run, and with background rehash on every
+// chunk takes its lock, so leave that off for scaling. Multi-line FASTQ records are supported.
+class ReadPipeline{
+public:
+    friend class Grader;
+    friend class Tester;
+    // threads 0 uses every hardware thread
+    ReadPipeline(const VDetect& vdetect, unsigned int k, unsigned int threads = 0, size_t chunk = PIPECHUNK);
+    // classifies the files one after the other, "-" for stdin; false if one cannot be read
+    bool run(const vector<string>& paths, ostream& out);
+    bool run(istream& in, ostream& out);
+    // counts and time of the last run
+    const PipelineStats& stats() const {return m_stats;}
+
+private:
+    struct Chunk{
+        size_t index;       // position in the input, results are written in this order
+        string text;
+    };
+    struct WorkQueue{
+        mutex         lock;
+        deque<Chunk>  chunks;
+    };
+
+    const VDetect&  m_vdetect;
+    unsigned int    m_k;
+    unsigned int    m_threads;
+    size_t          m_chunk;
+
+    vector<WorkQueue>* m_queues;    // one per worker while a run is going
+    atomic<size_t>  m_queued;       // chunks in all queues
+    size_t          m_submitted;    // chunks handed out so far
+    size_t          m_inFlight;     // chunks handed out and not written yet
+    bool            m_closed;       // the input is exhausted
+    mutex           m_lock;         // guards m_inFlight and m_closed, taken after m_mergeLock
+    condition_variable m_ready;     // a chunk was queued or the input closed
+    condition_variable m_space;     // a chunk was written
+
+    ostream*        m_out;
+    map<size_t, string> m_finished; // results that wait for an earlier chunk
+    size_t          m_nextOut;      // index of the next chunk to write
+    mutex           m_mergeLock;    // guards the merge state and m_stats
+    PipelineStats   m_stats;
+
+    // runs feed on the calling thread with the workers up
+    bool process(const vector<string>& paths, istream* in, ostream& out);
+    bool feed(istream& in);
+    void submit(string text);
+    bool takeChunk(unsigned int worker, Chunk& chunk);
+    void work(unsigned int worker);
+    void deliver(size_t index, string output, const KmerScanner& scanner, size_t classified);
+};
+
+// end of the last whole record in text, 0 when text holds no whole record
+size_t lastRecordEnd(string_view text, bool fastq);
+#endif
@@ -0,0 +1,149 @@
+#ifndef STATICVDETECT_H
+#define STATICVDETECT_H
+#include "tablepair.h"
+
+// hashers for StaticVDetect, they get the key and its packed form so neither has to be rebuilt
+struct PackedHasher{
+    unsigned int operator()(const string&, const PackedKey& packed) const {return packed.hash();}
+};
+
+template <hash_fn Fn>
+struct FnHasher{
+    unsigned int operator()(const string& key, const PackedKey&) const {return Fn(key);}
+};
+
+// VDetect with the probing policy (NoProbe, QuadraticProbe, DoubleHashProbe or GroupProbe) and the
+// hasher fixed at compile time, so the probe loop and the hash are inlined into every operation.
+// There is no changeProbPolicy, capacities are powers of two and the rehash rules are the ones of VDetect.
+template <class Probe, class Hasher = PackedHasher>
+class StaticVDetect{
+public:
+    friend class Grader;
+    friend class Tester;
+    explicit StaticVDetect(size_t size);
+    ~StaticVDetect();
+    // Returns Load factor of the new table
+    float lambda() const;
+    // Returns the ratio of deleted slots in the new table
+    float deletedRatio() const;
+    // insert only happens in the new table, false when the virus is not stored: a duplicate,
+    // an ID out of range or a full probe sequence
+    bool insert(const Virus& virus);
+    // remove can happen from either table
+    bool remove(const Virus& virus);
+    // find can happen in either table
+    Virus getVirus(const string& key, int id) const;
+
+private:
+    typedef PairTable<Slot> Table;
+
+    Hasher m_hasher;
+    Table  m_current;
+    Table  m_old;
+    size_t m_cursor;        // first old slot that has not been migrated yet
+
+    size_t findIndex(const Table& table, const PackedKey& key, unsigned int hash, int id) const;
+    // false when the probe sequence of slot is full
+    bool insertHelper(const Slot& slot);
+    void rehashHelper();
+    bool eraseFrom(Table& table, const PackedKey& key, unsigned int hash, int id);
+};
+
+template <class Probe, class Hasher>
+StaticVDetect<Probe, Hasher>::StaticVDetect(size_t size){
+    m_current = Table::allocate(pow2CapFor(size));
+    m_old = Table::none();
+    m_cursor = 0;
+}
+
+template <class Probe, class Hasher>
+StaticVDetect<Probe, Hasher>::~StaticVDetect(){
+    m_current.release();
+    m_old.release();
+}
+
+template <class Probe, class Hasher>
+float StaticVDetect<Probe, Hasher>::lambda() const{
+    return m_current.load();
+}
+
+template <class Probe, class Hasher>
+float StaticVDetect<Probe, Hasher>::deletedRatio() const{
+    return m_current.deletedRatio();
+}
+
+template <class Probe, class Hasher>
+bool StaticVDetect<Probe, Hasher>::insert(const Virus& virus){
+    bool inserted = false;
+    if (virus.getID() >= MINID && virus.getID() <= MAXID) {
+        PackedKey packed(virus.getKey());
+        unsigned int hash = m_hasher(virus.getKey(), packed);
+        if (findIndex(m_current, packed, hash, virus.getID()) == NOSLOT &&
+            (m_old.slots == nullptr || findIndex(m_old, packed, hash, virus.getID()) == NOSLOT)) {
+            migrateHash<Probe>(m_current, m_old, m_cursor, hash, [](const Slot& slot) {return slot.m_hash;},
+                [&](const Slot& slot) {return insertHelper(slot);}, [](const Slot&) {});
+            inserted = insertHelper(Slot(packed, virus.getID(), hash));
+        }
+    }
+    rehashHelper();
+    return inserted;
+}
+
+template <class Probe, class Hasher>
+bool StaticVDetect<Probe, Hasher>::remove(const Virus& virus){
+    PackedKey packed(virus.getKey());
+    unsigned int hash = m_hasher(virus.getKey(), packed);
+    bool removed = eraseFrom(m_current, packed, hash, virus.getID()) ||
+                   (m_old.slots != nullptr && eraseFrom(m_old, packed, hash, virus.getID()));
+    rehashHelper();
+    return removed;
+}
+
+template <class Probe, class Hasher>
+Virus StaticVDetect<Probe, Hasher>::getVirus(const string& key, int id) const{
+    PackedKey packed(key);
+    unsigned int hash = m_hasher(key, packed);
+    size_t index = findIndex(m_current, packed, hash, id);
+    if (index != NOSLOT)
+        return m_current.slots[index].toVirus();
+    if (m_old.slots != nullptr) {
+        index = findIndex(m_old, packed, hash, id);
+        if (index != NOSLOT)
+            return m_old.slots[index].toVirus();
+    }
+    return EMPTY;
+}
+
+template <class Probe, class Hasher>
+size_t StaticVDetect<Probe, Hasher>::findIndex(const Table& table, const PackedKey& key, unsigned int hash, int id) const{
+    return probeFind<Probe, POW2CAP>(table.slots, table.ctrl, table.cap, hash,
+        [&](const Slot& slot) {return slot.matches(key, id, hash);});
+}
+
+template <class Probe, class Hasher>
+bool StaticVDetect<Probe, Hasher>::insertHelper(const Slot& slot){
+    size_t index = probeFree<Probe, POW2CAP>(m_current.ctrl, m_current.cap, slot.m_hash);
+    if (index == NOSLOT) // there is no stash, insert reports the virus as not stored
+        return false;
+    m_current.slots[index] = slot;
+    setCtrl(m_current.ctrl, m_current.cap, index, hashFragment(slot.m_hash));
+    m_current.size++;
+    return true;
+}
+
+template <class Probe, class Hasher>
+bool StaticVDetect<Probe, Hasher>::eraseFrom(Table& table, const PackedKey& key, unsigned int hash, int id){
+    size_t index = findIndex(table, key, hash, id);
+    if (index == NOSLOT)
+        return false;
+    table.slots[index] = Slot(); // lookups only read the control byte
+    setCtrl(table.ctrl, table.cap, index, CTRLDELETED);
+    table.numDeleted++;
+    return true;
+}
+
+template <class Probe, class Hasher>
+void StaticVDetect<Probe, Hasher>::rehashHelper(){
+    rehashStep(m_current, m_old, m_cursor, [&](const Slot& slot) {return insertHelper(slot);}, [](const Slot&) {});
+}
+#endif
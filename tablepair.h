@@ -0,0 +1,129 @@
+#ifndef TABLEPAIR_H
+#define TABLEPAIR_H
+#include <vector>
+#include "vdetect.h"
+
+// a table of the VDetects whose probing is fixed at compile time (StaticVDetect, KmerVDetect and
+// GroupedVDetect). Each of them keeps a current and an old table of Entry and rehashes them with
+// rehashStep, so they share the rules of VDetect: power of two capacities, a rehash once the current
+// table passes DEFMAXLOAD or DEFMAXDELETED, and migrationBudget old entries moved per operation
+template <class Entry>
+struct PairTable{
+    Entry*  slots;      // nullptr for the old table when no rehash is running
+    ctrl_t* ctrl;       // control byte of every slot
+    size_t  cap;        // hash table size (capacity)
+    size_t  size;       // number of entries, deleted ones included
+    size_t  numDeleted; // number of deleted entries
+
+    // an empty table of cap slots, entries are value initialized
+    static PairTable allocate(size_t cap) {return PairTable{new Entry[cap](), newCtrl(cap), cap, 0, 0};}
+    static PairTable none() {return PairTable{nullptr, nullptr, 0, 0, 0};}
+    void release() {
+        delete [] slots;
+        delete [] ctrl;
+        *this = none();
+    }
+    float load() const {return float(size) / float(cap);}
+    float deletedRatio() const {return size == 0 ? 0 : float(numDeleted) / float(size);}
+    size_t live() const {return size - numDeleted;}
+};
+
+// smallest power of two capacity holding size slots, never below MINPOW2
+inline size_t pow2CapFor(size_t size){
+    size_t cap = MINPOW2;
+    while (cap < size)
+        cap *= 2;
+    return cap;
+}
+
+// moves the live entries of current and old into a new current table of twice the capacity,
+// doubling again until they all fit; place puts one entry into current and returns false when its
+// probe sequence is full. After REBUILDTRIES doublings the entries that still find no slot, equal
+// hashes no capacity separates, are handed to lost
+template <class Entry, class Place, class Lost>
+void rebuildPair(PairTable<Entry>& current, PairTable<Entry>& old, size_t& cursor, Place place, Lost lost){
+    PairTable<Entry> from[2] = {current, old};
+    old = PairTable<Entry>::none();
+    cursor = 0;
+    size_t cap = from[0].cap;
+    for (int attempt = 1; ; attempt++) {
+        cap *= 2;
+        current = PairTable<Entry>::allocate(cap);
+        bool last = attempt == REBUILDTRIES;
+        bool fits = true;
+        for (int t = 0; t < 2 && (fits || last); t++) {
+            for (size_t i = 0; i < from[t].cap && (fits || last); i++) {
+                if (from[t].ctrl[i] < 0)
+                    continue;
+                Entry copy = from[t].slots[i]; // a failed attempt leaves the sources whole
+                if (place(copy))
+                    continue;
+                fits = false;
+                if (last)
+                    lost(from[t].slots[i]);
+            }
+        }
+        if (fits || last)
+            break;
+        current.release();
+    }
+    from[0].release();
+    from[1].release();
+}
+
+// starts a rehash when current is due for one and moves the next migrationBudget live entries of
+// old, resuming at cursor; place puts one old entry into current and its old slot is marked DELETED.
+// An entry place finds no room for was already stored, so the tables are rebuilt with rebuildPair
+template <class Entry, class Place, class Lost>
+void rehashStep(PairTable<Entry>& current, PairTable<Entry>& old, size_t& cursor, Place place, Lost lost){
+    if (old.slots == nullptr && (current.load() > DEFMAXLOAD || current.deletedRatio() > DEFMAXDELETED)) {
+        old = current;
+        current = PairTable<Entry>::allocate(pow2CapFor(old.live() * 4));
+        cursor = 0;
+    }
+    if (old.slots == nullptr)
+        return;
+
+    size_t budget = migrationBudget(old.size);
+    for (; cursor < old.cap && budget > 0; cursor++) {
+        if (old.ctrl[cursor] >= 0) {
+            if (!place(old.slots[cursor])) {
+                rebuildPair(current, old, cursor, place, lost);
+                return;
+            }
+            setCtrl(old.ctrl, old.cap, cursor, CTRLDELETED);
+            old.numDeleted++;
+            budget--;
+        }
+    }
+    if (old.numDeleted == old.size)
+        old.release();
+}
+
+// moves the live entries of old whose hash is hash into current, call it before a new entry of that
+// hash is placed: every ID of a key has the key's hash, so an ID stored before the rehash takes its
+// slot in current first and the new entry is the one refused when the probe sequence has no room.
+// Entries of one hash all sit on its probe sequence in old; hashOf gives the hash of an entry
+template <class Probe, class Entry, class HashOf, class Place, class Lost>
+void migrateHash(PairTable<Entry>& current, PairTable<Entry>& old, size_t& cursor, unsigned int hash,
+                 HashOf hashOf, Place place, Lost lost){
+    if (old.slots == nullptr)
+        return;
+    vector<size_t> waiting;
+    probeFind<Probe, POW2CAP>(old.slots, old.ctrl, old.cap, hash, [&](const Entry& entry) {
+        if (hashOf(entry) == hash)
+            waiting.push_back(&entry - old.slots);
+        return false; // walks the whole probe sequence
+    });
+    for (size_t index : waiting) {
+        if (!place(old.slots[index])) {
+            rebuildPair(current, old, cursor, place, lost);
+            return;
+        }
+        setCtrl(old.ctrl, old.cap, index, CTRLDELETED);
+        old.numDeleted++;
+    }
+    if (old.numDeleted == old.size)
+        old.release();
+}
+#endif
@@ -1,63 +1,145 @@
 #include "vdetect.h"
-VDetect::VDetect(int size, hash_fn hash, prob_t probing = DEFPOLCY){
-    if (isPrime(size)) { // check if the size was a prime number if it is set cap to it
+#include "journal.h"
+#include "epoch.h"
+#include <atomic>
+static const Slot DELETEDSLOT(DELETED); // packed once, copied into removed slots
+// deleters handed to the epoch domain
+static void deleteSlots(void* slots){delete [] static_cast<Slot*>(slots);}
+static void deleteCtrl(void* ctrl){delete [] static_cast<ctrl_t*>(ctrl);}
+static void deleteWords(void* words){delete [] static_cast<uint64_t*>(words);}
+static void deleteArena(void* arena){delete static_cast<KeyArena*>(arena);}
+#ifdef VDETECT_STATS
+#define COUNTSTAT(stat, n) m_stats.count(stat, n)
+#define COUNTPROBE(table) m_stats.probe(table, lastProbes)
+#else
+#define COUNTSTAT(stat, n) ((void)0)
+#define COUNTPROBE(table) ((void)0)
+#endif
+VDetect::VDetect(size_t size, hash_fn hash, prob_t probing = DEFPOLCY, cap_t capacity){
+    m_capMode = capacity;
+    if (m_capMode == POW2CAP) { // round up to a power of two, index math never divides
+        m_currentCap = findNextPow2(size);
+    } else if (isPrime(size)) { // check if the size was a prime number if it is set cap to it
         m_currentCap = size;
     } else {
         m_currentCap = findNextPrime(size); // use this to find the next closest prime than
     }
 
-    if (size < MINPRIME) { // size less than the min prime than set size to min prime
+    if (m_capMode == PRIMECAP && size < MINPRIME) { // size less than the min prime than set size to min prime
         m_currentCap = MINPRIME;
     }
-    if(size > MAXPRIME) {
-        m_currentCap = MAXPRIME;
-    }
 
     m_currNumDeleted = 0;
     m_currentSize = 0;
-    m_currentTable = new Virus[m_currentCap]; // allocate memory to the table
-    for(int i = 0; i < m_currentCap; i++){ // set everything to empty
-        m_currentTable[i] = EMPTY;
-    }
+    m_currentTable = new Slot[m_currentCap]; // allocate memory to the table, slots start empty
+    m_currentCtrl = newCtrl(m_currentCap);
+    m_currentOccupied = newOccupancy(m_currentCap);
+    m_currentArena = new KeyArena();
+    m_currentFilter = nullptr;
     m_currProbing = probing;
 
     m_oldProbing = NONE;
     m_oldCap = 0;
     m_oldTable = nullptr;
+    m_oldCtrl = nullptr;
+    m_oldOccupied = nullptr;
+    m_oldArena = nullptr;
+    m_oldFilter = nullptr;
     m_oldNumDeleted = 0;
     m_oldSize = 0;
 
     m_hash = hash;
     m_newPolicy = m_currProbing;
+    m_epoch = nullptr;
+    m_journal = nullptr;
+    m_prefilter = false;
+    m_filterRemovals = 0;
+    m_hamming = nullptr;
+    m_background = false;
+    m_stop = false;
+
+    m_stashSize = 0;
+    m_grow = false;
+    m_grown = false;
+    m_cursor = 0;
+    m_slotBudget = 0;
+    m_timeBudget = chrono::microseconds(0);
+    m_maxLoad = DEFMAXLOAD;
+    m_maxDeleted = DEFMAXDELETED;
+#ifdef VDETECT_STATS
+    m_lastRehash = chrono::nanoseconds(0);
+#endif
 }
 
 VDetect::~VDetect(){ // deallocate all the table
-    delete [] m_currentTable;
+    setBackgroundRehash(false);
+    delete [] m_currentTable; // the slots only borrow from the arena, no key is freed one by one
+    delete [] m_currentCtrl;
+    delete [] m_currentOccupied;
+    delete m_currentArena;
+    delete m_currentFilter;
+    delete m_hamming;
 
     if (m_oldTable) {
         delete [] m_oldTable;
+        delete [] m_oldCtrl;
+        delete [] m_oldOccupied;
+        delete m_oldArena;
+        delete m_oldFilter;
     }
 }
 
 void VDetect::changeProbPolicy(prob_t policy){
+    unique_lock<mutex> guard = lockTables();
     if (!m_oldTable) { // set new policy if changed
         m_newPolicy = policy;
     }
 }
 
-bool VDetect::insert(Virus virus){
+bool VDetect::insert(const Virus& virus){
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(virus.m_key);
+    return insertPacked(packed, hashKey(virus.m_key, packed), virus.m_id); // the only hash_fn call of this insert
+}
+
+bool VDetect::insertPacked(const PackedKey& packed, unsigned int hash, int id){
 
-    if (virus.m_id < MINID || virus.m_id > MAXID) { // can't insert if this is true but still need to cqll rehash
+    if (id < MINID || id > MAXID) { // can't insert if this is true but still need to cqll rehash
+        COUNTSTAT(STATINSERTREJECTED, 1);
         rehashHelper();
         return false;
     }
 
-    if (getVirus(virus.m_key, virus.m_id) == virus) { // check for duplicates
+    if (findSlot(packed, hash, id) != nullptr) { // check for duplicates
+        COUNTSTAT(STATINSERTREJECTED, 1);
         rehashHelper();
         return false;
     }
 
-    insertHelper(virus); // insert your virus
+    Slot slot(packed, id, hash);
+    bool stored = placeSlot(slot);
+    if (!stored) {
+        // entries still in the old table were stored first, they get the stash before this one
+        if (m_oldTable != nullptr) {
+            migrate(m_oldSize);
+            stored = placeSlot(slot); // a migration that ran out of room moved everything to a bigger table
+        }
+    }
+    if (!stored) {
+        COUNTSTAT(STATPROBEFAIL, 1);
+        stored = stashSlot(slot);
+    }
+    if (!stored) { // no slot and a full stash, nothing was stored
+        rehashHelper();
+        return false;
+    }
+    COUNTSTAT(STATINSERT, 1);
+    if (m_journal != nullptr) // logged under the table lock, so the log has the order of the table
+        m_journal->logInsert(packed, id);
+    if (!m_byId.empty()) // a rehash moves the slot but never changes its key or ID, the list stays valid
+        m_byId[id - MINID].push_back(packed);
+    if (m_hamming != nullptr)
+        m_hamming->add(packed, id);
 
     rehashHelper(); // rehash
 
@@ -69,78 +151,70 @@ bool VDetect::insert(Virus virus){
     // need a rehash helper function
 }
 
-bool VDetect::remove(Virus virus){
-    // check for load factor of 0.8 for remove
-    int index; // use for equation
-
-    if (getVirus(virus.m_key, virus.m_id) == virus) { // the virus should exist
-
-        if (m_currProbing == NONE) {
-            index = m_hash(virus.m_key) % m_currentCap; // none equation
-            if (m_currentTable[index] == virus) { // if you find it set to deleted
-                m_currentTable[index] = DELETED;
-                m_currNumDeleted += 1;
-                rehashHelper(); // rehash
-                return true;
-            }
-        }
+bool VDetect::remove(const Virus& virus){
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(virus.m_key); // packed and hashed once, compared word by word
+    return removePacked(packed, hashKey(virus.m_key, packed), virus.m_id);
+}
 
-        if (m_currProbing == QUADRATIC) {
-            for (int i = 0; i < m_currentCap/2; ++i) {
-                index = ((m_hash(virus.m_key)) % m_currentCap) + (i * i) % m_currentCap; // quadratic equation
-                if (m_currentTable[index] == virus) {
-                    m_currentTable[index] = DELETED;
-                    m_currNumDeleted += 1;
-                    rehashHelper();
-                    return true;
-                }
-            }
-        }
+bool VDetect::removePacked(const PackedKey& packed, unsigned int hash, int id){
+    bool removed = eraseEntry(packed, hash, id);
+    COUNTSTAT(removed ? STATREMOVE : STATREMOVEMISS, 1);
+    if (removed && m_journal != nullptr)
+        m_journal->logRemove(packed, id);
+    if (removed && !m_byId.empty())
+        unindex(packed, id);
+    if (removed && m_hamming != nullptr)
+        m_hamming->remove(packed, id);
+    // removed keys stay in the filters, ROBINHOOD and CUCKOO churn never rehashes them away
+    if (removed && m_prefilter && ++m_filterRemovals > max(liveCount(), m_currentCap / 4))
+        buildFilters();
+    return removed;
+}
 
-        if (m_currProbing == DOUBLEHASH) {
-            for (int i = 0; i < m_currentCap; ++i) {
-                index = ((m_hash(virus.m_key) % m_currentCap) + i * (11 - (m_hash(virus.m_key) % 11))) % m_currentCap; // double hash equation
-                if (m_currentTable[index] == virus) {
-                    m_currentTable[index] = DELETED;
-                    m_currNumDeleted += 1;
-                    rehashHelper();
-                    return true;
-                }
-            }
-        }
-        // do the same for old table too
-        if (m_oldProbing == NONE) {
-            index = m_hash(virus.m_key) % m_oldCap;
-            if (m_oldTable[index] == virus) {
-                m_oldTable[index] = DELETED;
-                m_oldNumDeleted += 1;
-                rehashHelper();
-                return true;
-            }
+bool VDetect::eraseEntry(const PackedKey& packed, unsigned int hash, int id){
+    // check for load factor of 0.8 for remove
+    size_t index = findIndex(m_currentTable, m_currentCtrl, m_currentCap, m_currProbing, hash, packed, id);
+    if (index != NOSLOT && (m_currProbing == ROBINHOOD || m_currProbing == CUCKOO)) { // the entry leaves, nothing is marked
+        if (m_currProbing == ROBINHOOD) {
+            backwardShift(index);
+        } else { // cuckoo lookups never stop early, the slot just becomes EMPTY
+            clearSlot(m_currentTable[index]);
+            m_currentTable[index] = Slot();
+            setSlotCtrl(m_currentCtrl, m_currentCap, index, CTRLEMPTY);
         }
+        m_currentSize -= 1;
+        rehashHelper();
+        return true;
+    }
+    if (index != NOSLOT) { // if you find it set to deleted
+        clearSlot(m_currentTable[index]);
+        setSlotCtrl(m_currentCtrl, m_currentCap, index, CTRLDELETED);
+        m_currNumDeleted += 1;
+        rehashHelper(); // rehash
+        return true;
+    }
 
-        if (m_oldProbing == QUADRATIC) {
-            for (int i = 0; i < m_oldCap/2; ++i) {
-                index = ((m_hash(virus.m_key)) % m_oldCap) + (i * i) % m_oldCap;
-                if (m_oldTable[index] == virus) {
-                    m_oldTable[index] = DELETED;
-                    m_oldNumDeleted += 1;
-                    rehashHelper();
-                    return true;
-                }
-            }
+    // do the same for old table too
+    if (m_oldTable != nullptr) {
+        index = findIndex(m_oldTable, m_oldCtrl, m_oldCap, m_oldProbing, hash, packed, id);
+        if (index != NOSLOT) {
+            clearSlot(m_oldTable[index]);
+            setSlotCtrl(m_oldCtrl, m_oldCap, index, CTRLDELETED);
+            m_oldNumDeleted += 1;
+            rehashHelper();
+            return true;
         }
+    }
 
-        if (m_oldProbing == DOUBLEHASH) {
-            for (int i = 0; i < m_currentCap; ++i) {
-                index = ((m_hash(virus.m_key) % m_oldCap) + i * (11 - (m_hash(virus.m_key) % 11))) % m_oldCap;
-                if (m_oldTable[index] == virus) {
-                    m_oldTable[index] = DELETED;
-                    m_oldNumDeleted += 1;
-                    rehashHelper();
-                    return true;
-                }
-            }
+    for (size_t i = 0; i < m_stashSize; i++) {
+        if (m_stash[i].matches(packed, id, hash)) { // the last stashed entry fills the gap
+            clearSlot(m_stash[i]);
+            m_stash[i] = std::move(m_stash[m_stashSize - 1]);
+            m_stash[m_stashSize - 1] = Slot();
+            m_stashSize -= 1;
+            rehashHelper();
+            return true;
         }
     }
 
@@ -149,104 +223,292 @@ bool VDetect::remove(Virus virus){
     return false;
 }
 
-Virus VDetect::getVirus(string key, int id) const{
+bool VDetect::emplace(string_view key, int id){
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(key);
+    return insertPacked(packed, hashKey(key, packed), id);
+}
 
-    int index = 0;
+bool VDetect::contains(string_view key, int id) const{
+    return findEntry(key, id) != nullptr;
+}
 
-    if (m_currProbing == NONE) {
-        if (m_currentTable != nullptr) {
-                index = m_hash(key) % m_currentCap;
-                if (m_currentTable[index].m_key == key && m_currentTable[index].m_id == id) { // if it matches than it returns the virus at that index
-                    return m_currentTable[index];
-                }
-        }
+const Slot* VDetect::findEntry(string_view key, int id) const{
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(key); // no allocation for keys up to 32 bases
+    return lookupSlot(packed, hashKey(key, packed), id);
+}
+
+const Slot* VDetect::findKey(string_view key) const{
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(key);
+    return findKeySlot(packed, hashKey(key, packed));
+}
+
+vector<int> VDetect::findAll(string_view key) const{
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(key);
+    unsigned int hash = hashKey(key, packed);
+    vector<int> ids;
+    // the match never succeeds, so the probe runs to the end of the sequence collecting IDs
+    auto collect = [&](const Slot& slot) {
+        if (slot.matchesKey(packed, hash))
+            ids.push_back(slot.m_id);
+        return false;
+    };
+    auto walk = [&](const Slot* table, const ctrl_t* ctrl, size_t cap, prob_t probing, const BloomFilter* filter) {
+        if (filter != nullptr && !filter->mayContain(hash))
+            return;
+        withPolicy(probing, m_capMode, [&](auto policy) {
+            typedef decltype(policy) P;
+            return probeFind<typename P::Probe, P::mode>(table, ctrl, cap, hash, collect);
+        });
+    };
+    walk(m_currentTable, m_currentCtrl, m_currentCap, m_currProbing, m_currentFilter);
+    if (m_oldTable != nullptr)
+        walk(m_oldTable, m_oldCtrl, m_oldCap, m_oldProbing, m_oldFilter);
+    for (size_t i = 0; i < m_stashSize; i++)
+        collect(m_stash[i]);
+    return ids;
+}
+
+optional<Virus> VDetect::findVirus(string_view key, int id) const{
+    if (!contains(key, id))
+        return nullopt;
+    return Virus(string(key), id); // a match has the key and ID of the query
+}
+
+Virus VDetect::getVirus(const string& key, int id) const{
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(key); // compare packed words instead of strings
+    const Slot* slot = lookupSlot(packed, hashKey(key, packed), id);
+
+    if (slot != nullptr) { // if it matches than it returns the virus in that slot
+        return slot->toVirus();
     }
 
-    if (m_currProbing == QUADRATIC) {
-        cout << "hi" << endl;
-        if (m_currentTable != nullptr) {
-            for (int i = 0; i < m_currentCap/2; i++) {
-                index = ((m_hash(key)% m_currentCap) + (i * i)) % m_currentCap;
-                cout << index << endl;
-                if (m_currentTable[index].m_key == key && m_currentTable[index].m_id == id) {
-                    return m_currentTable[index];
-                }
-            }
-        }
+    return EMPTY;
+}
+
+size_t VDetect::insertBatch(const vector<Virus>& viruses){
+    unique_lock<mutex> guard = lockTables(); // one hold for the whole batch
+    vector<PackedKey> packed;
+    vector<unsigned int> hashes;
+    packBatch(viruses, packed, hashes);
+    size_t inserted = 0;
+    for (size_t i = 0; i < viruses.size(); i++) {
+        if (i + PREFETCHAHEAD < viruses.size()) // a rehash may move the slot, the prefetch is only a hint
+            prefetchHome(hashes[i + PREFETCHAHEAD]);
+        if (insertPacked(packed[i], hashes[i], viruses[i].m_id))
+            inserted++;
     }
+    return inserted;
+}
 
-    if (m_currProbing == DOUBLEHASH) {
-        if (m_currentTable != nullptr) {
-            for (int i = 0; i < m_currentCap; i++) {
-                index = ((m_hash(key) % m_currentCap) + i * (11 -(m_hash(key) % 11))) % m_currentCap;
-                if (m_currentTable[index].m_key == key && m_currentTable[index].m_id == id) {
-                    return m_currentTable[index];
-                }
-            }
-        }
+size_t VDetect::removeBatch(const vector<Virus>& viruses){
+    unique_lock<mutex> guard = lockTables(); // one hold for the whole batch
+    vector<PackedKey> packed;
+    vector<unsigned int> hashes;
+    packBatch(viruses, packed, hashes);
+    size_t removed = 0;
+    for (size_t i = 0; i < viruses.size(); i++) {
+        if (i + PREFETCHAHEAD < viruses.size())
+            prefetchHome(hashes[i + PREFETCHAHEAD]);
+        if (removePacked(packed[i], hashes[i], viruses[i].m_id))
+            removed++;
     }
-    // do it for old table too
-    if (m_oldProbing == NONE) {
-        if (m_oldTable != nullptr) {
-            index = m_hash(key) % m_oldCap;
-            if (m_oldTable[index].m_key == key && m_oldTable[index].m_id == id) {
-                return m_oldTable[index];
-            }
-        }
+    return removed;
+}
+
+vector<Virus> VDetect::getVirusBatch(const vector<Virus>& queries) const{
+    unique_lock<mutex> guard = lockTables(); // one hold for the whole batch
+    vector<PackedKey> packed;
+    vector<unsigned int> hashes;
+    packBatch(queries, packed, hashes);
+    vector<Virus> results(queries.size(), EMPTY);
+    for (size_t i = 0; i < queries.size() && i < PREFETCHAHEAD; i++) // fills the pipeline
+        prefetchHome(hashes[i]);
+    for (size_t i = 0; i < queries.size(); i++) {
+        if (i + PREFETCHAHEAD < queries.size())
+            prefetchHome(hashes[i + PREFETCHAHEAD]);
+        if (lookupSlot(packed[i], hashes[i], queries[i].m_id) != nullptr)
+            results[i] = queries[i]; // a match has the same key and ID as the query
     }
+    return results;
+}
 
-    if (m_oldProbing == QUADRATIC) {
-        if (m_oldTable != nullptr) {
-            for (int i = 0; i < m_oldCap/2; i++) {
-                index = ((m_hash(key)) % m_oldCap) + (i * i) % m_oldCap;
-                if (m_oldTable[index].m_key == key && m_oldTable[index].m_id == id) {
-                    return m_oldTable[index];
-                }
-            }
-        }
+void VDetect::packBatch(const vector<Virus>& viruses, vector<PackedKey>& packed, vector<unsigned int>& hashes) const{
+    packed.reserve(viruses.size());
+    hashes.reserve(viruses.size());
+    for (size_t i = 0; i < viruses.size(); i++) {
+        packed.push_back(PackedKey(viruses[i].m_key));
+        hashes.push_back(hashKey(viruses[i].m_key, packed[i]));
     }
+}
 
-    if (m_oldProbing == DOUBLEHASH) {
-        if (m_oldTable != nullptr) {
-            for (int i = 0; i < m_oldCap; i++) {
-                index = ((m_hash(key) % m_oldCap) + i * (11 -(m_hash(key) % 11))) % m_oldCap;
-                if (m_oldTable[index].m_key == key && m_oldTable[index].m_id == id) {
-                    return m_oldTable[index];
-                }
-            }
+void VDetect::prefetchHome(unsigned int hash) const{
+    size_t index = homeIndex(hash, m_currentCap);
+    if (m_currProbing == CUCKOO) { // the control bytes of both buckets, the slots follow a fragment match
+        size_t first, second;
+        cuckooBucketsOf(hash, first, second);
+        __builtin_prefetch(&m_currentCtrl[second * BUCKETWAYS]);
+        index = first * BUCKETWAYS;
+    }
+    __builtin_prefetch(&m_currentCtrl[index]);
+    __builtin_prefetch(&m_currentTable[index]);
+    if (m_oldTable != nullptr) {
+        index = homeIndex(hash, m_oldCap);
+        __builtin_prefetch(&m_oldCtrl[index]);
+        __builtin_prefetch(&m_oldTable[index]);
+    }
+}
+
+const Slot* VDetect::findSlot(const PackedKey& key, unsigned int hash, int id) const{
+    size_t index = NOSLOT;
+    if (m_currentFilter == nullptr || m_currentFilter->mayContain(hash))
+        index = findIndex(m_currentTable, m_currentCtrl, m_currentCap, m_currProbing, hash, key, id);
+    if (index != NOSLOT) {
+        return &m_currentTable[index];
+    }
+    // do it for old table too
+    if (m_oldTable != nullptr && (m_oldFilter == nullptr || m_oldFilter->mayContain(hash))) {
+        index = findIndex(m_oldTable, m_oldCtrl, m_oldCap, m_oldProbing, hash, key, id);
+        if (index != NOSLOT) {
+            return &m_oldTable[index];
         }
     }
+    for (size_t i = 0; i < m_stashSize; i++) {
+        if (m_stash[i].matches(key, id, hash))
+            return &m_stash[i];
+    }
+    return nullptr;
+}
 
-    return EMPTY;
+const Slot* VDetect::lookupSlot(const PackedKey& key, unsigned int hash, int id) const{
+    const Slot* slot = findSlot(key, hash, id);
+    COUNTSTAT(STATLOOKUP, 1);
+    COUNTSTAT(STATLOOKUPMISS, slot == nullptr);
+    return slot;
+}
+
+const Slot* VDetect::findKeySlot(const PackedKey& key, unsigned int hash) const{
+    // an entry sits on the probe sequence of its hash whatever its ID, so the usual probe finds it
+    auto probe = [&](const Slot* table, const ctrl_t* ctrl, size_t cap, prob_t probing) {
+        return withPolicy(probing, m_capMode, [&](auto policy) {
+            typedef decltype(policy) P;
+            return probeFind<typename P::Probe, P::mode>(table, ctrl, cap, hash,
+                [&](const Slot& slot) {return slot.matchesKey(key, hash);});
+        });
+    };
+    size_t index = NOSLOT;
+    if (m_currentFilter == nullptr || m_currentFilter->mayContain(hash))
+        index = probe(m_currentTable, m_currentCtrl, m_currentCap, m_currProbing);
+    if (index != NOSLOT)
+        return &m_currentTable[index];
+    if (m_oldTable != nullptr && (m_oldFilter == nullptr || m_oldFilter->mayContain(hash))) {
+        index = probe(m_oldTable, m_oldCtrl, m_oldCap, m_oldProbing);
+        if (index != NOSLOT)
+            return &m_oldTable[index];
+    }
+    for (size_t i = 0; i < m_stashSize; i++) {
+        if (m_stash[i].matchesKey(key, hash))
+            return &m_stash[i];
+    }
+    return nullptr;
+}
+
+unsigned int VDetect::hashKey(string_view key, const PackedKey& packed) const{
+    if (m_hash == packedHashCode) // same value, without packing the string a second time
+        return packed.hash();
+    return m_hash(string(key)); // hash_fn takes a string, only user hash functions pay for the copy
+}
+
+size_t VDetect::liveCount() const{
+    size_t live = m_currentSize - m_currNumDeleted;
+    if (m_oldTable != nullptr)
+        live += m_oldSize - m_oldNumDeleted;
+    return live + m_stashSize;
 }
 
 float VDetect::lambda() const { // get's the load factor
+    unique_lock<mutex> guard = lockTables();
     return float (m_currentSize) / float(m_currentCap);
 }
 
 float VDetect::deletedRatio() const { // get's deleted ration
+    unique_lock<mutex> guard = lockTables();
     if (m_currentSize == 0) {
         return 0;
     }
     return float(m_currNumDeleted) / float (m_currentSize);
 }
 
+VDetectStats VDetect::stats() const {
+    unique_lock<mutex> guard = lockTables();
+    VDetectStats stats = VDetectStats();
+#ifdef VDETECT_STATS
+    stats.enabled = true;
+    m_stats.collect(stats);
+    stats.lastRehashNanos = m_lastRehash.count();
+#endif
+    stats.currentCap = m_currentCap;
+    stats.currentLive = m_currentSize - m_currNumDeleted;
+    stats.currentDeleted = m_currNumDeleted;
+    stats.stashSize = m_stashSize;
+    stats.migrationProgress = 1;
+    if (m_oldTable != nullptr) {
+        stats.oldCap = m_oldCap;
+        stats.oldLive = m_oldSize - m_oldNumDeleted;
+        stats.migrationProgress = double(m_cursor) / double(m_oldCap);
+    }
+
+    // every allocation of the tables, sized the way it was made
+    size_t caps[2] = {m_currentCap, m_oldTable != nullptr ? m_oldCap : 0};
+    for (size_t cap : caps) {
+        if (cap == 0)
+            continue;
+        stats.tableBytes += cap * sizeof(Slot);
+        stats.ctrlBytes += (cap + GROUPWIDTH - 1) * sizeof(ctrl_t);
+        stats.occupancyBytes += (cap + 63) / 64 * sizeof(uint64_t);
+    }
+    stats.arenaBytes = m_currentArena->wordsReserved() * sizeof(uint64_t);
+    if (m_oldArena != nullptr)
+        stats.arenaBytes += m_oldArena->wordsReserved() * sizeof(uint64_t);
+    for (size_t i = 0; i < m_stashSize; i++)
+        stats.keyBytes += m_stash[i].m_key.heapBytes();
+    if (m_currentFilter != nullptr)
+        stats.filterBytes += m_currentFilter->bytes();
+    if (m_oldFilter != nullptr)
+        stats.filterBytes += m_oldFilter->bytes();
+    stats.idIndexBytes = m_byId.capacity() * sizeof(vector<PackedKey>);
+    for (const vector<PackedKey>& keys : m_byId) {
+        stats.idIndexBytes += keys.capacity() * sizeof(PackedKey);
+        for (const PackedKey& key : keys)
+            stats.idIndexBytes += key.heapBytes();
+    }
+    stats.objectBytes = sizeof(VDetect);
+    stats.totalBytes = stats.objectBytes + stats.tableBytes + stats.ctrlBytes + stats.occupancyBytes +
+                       stats.arenaBytes + stats.keyBytes + stats.filterBytes + stats.idIndexBytes;
+    return stats;
+}
+
 void VDetect::dump() const {
+    unique_lock<mutex> guard = lockTables();
     cout << "Dump for the current table: " << endl;
     if (m_currentTable != nullptr)
-        for (int i = 0; i < m_currentCap; i++) {
+        for (size_t i = 0; i < m_currentCap; i++) {
             cout << "[" << i << "] : " << m_currentTable[i] << endl;
         }
     cout << "Dump for the old table: " << endl;
     if (m_oldTable != nullptr)
-        for (int i = 0; i < m_oldCap; i++) {
+        for (size_t i = 0; i < m_oldCap; i++) {
             cout << "[" << i << "] : " << m_oldTable[i] << endl;
         }
 }
 
-bool VDetect::isPrime(int number){
+bool VDetect::isPrime(size_t number){
     bool result = true;
-    for (int i = 2; i <= number / 2; ++i) {
+    for (size_t i = 2; i * i <= number; ++i) { // a factor above the square root has a partner below it
         if (number % i == 0) {
             result = false;
             break;
@@ -255,21 +517,26 @@ bool VDetect::isPrime(int number){
     return result;
 }
 
-int VDetect::findNextPrime(int current){
-    //we always stay within the range [MINPRIME-MAXPRIME]
-    //the smallest prime starts at MINPRIME
+size_t VDetect::findNextPrime(size_t current){
+    //the smallest prime starts at MINPRIME, there is no upper limit
     if (current < MINPRIME) current = MINPRIME-1;
-    for (int i=current; i<MAXPRIME; i++) {
-        for (int j=2; j*j<=i; j++) {
-            if (i % j == 0)
-                break;
-            else if (j+1 > sqrt(i) && i != current) {
-                return i;
-            }
-        }
+    for (size_t i=current+1; ; i++) {
+        if (isPrime(i))
+            return i;
     }
-    //if a user tries to go over MAXPRIME
-    return MAXPRIME;
+}
+
+size_t VDetect::findNextPow2(size_t current){
+    size_t cap = MINPOW2;
+    while (cap < current)
+        cap *= 2;
+    return cap;
+}
+
+size_t VDetect::findNextCap(size_t current){
+    if (m_capMode == POW2CAP)
+        return findNextPow2(current);
+    return findNextPrime(current);
 }
 
 ostream& operator<<(ostream& sout, const Virus &virus ) {
@@ -284,87 +551,653 @@ bool operator==(const Virus& lhs, const Virus& rhs){
     return ((lhs.m_key == rhs.m_key) && (lhs.m_id == rhs.m_id));
 }
 
+ostream& operator<<(ostream& sout, const Slot &slot ) {
+    if (!slot.m_key.empty())
+        sout << slot.m_key.toString() << " (ID " << slot.m_id << ")";
+    else
+        sout << "";
+    return sout;
+}
+
+bool operator==(const Slot& lhs, const Virus& rhs){
+    return lhs.matches(PackedKey(rhs.getKey()), rhs.getID());
+}
+
 
 void VDetect::rehashHelper() {
-    if (m_oldTable == nullptr && (lambda() > 0.5 || deletedRatio() > 0.8 || m_newPolicy != m_currProbing)) { // only rehash on these condition
-        m_oldProbing = m_currProbing;
-        m_oldCap = m_currentCap;
-        m_oldTable = m_currentTable; // set old to the cur table
-        m_oldNumDeleted = m_currNumDeleted;
-        m_oldSize = m_currentSize;
+    bool bounded = m_slotBudget > 0 || m_timeBudget.count() > 0;
+    if ((m_background || bounded) && m_oldTable != nullptr && needsRehash()) {
+        migrate(m_oldSize); // the migration fell behind a table that needs to grow again, finish here
+    }
 
-        m_currentCap = findNextPrime((m_currentSize - m_currNumDeleted) * 4); // set new current cap
+    if (m_oldTable == nullptr && needsRehash()) { // only rehash on these condition
+        startRehash();
+        if (m_background)
+            m_wake.notify_one();
+    }
 
-        m_currNumDeleted = 0;
-        m_currentSize = 0;
+    if (m_oldTable == nullptr || m_background) { // won't just rehash on an empty old table so that's why we need those other conditions
+        return;
+    }
 
-        m_currProbing = m_newPolicy;
+    if (bounded)
+        migrateBounded();
+    else
+        migrate(migrationBudget(m_oldSize)); // 25% of live nodes per operation
+}
 
-        m_currentTable = new Virus[m_currentCap]; // make everything empty in there now
-        for (int i = 0; i < m_currentCap; i++) {
-            m_currentTable[i] = EMPTY;
-        }
+bool VDetect::needsRehash() const {
+    float load = float(m_currentSize) / float(m_currentCap);
+    float deleted = m_currentSize == 0 ? 0 : float(m_currNumDeleted) / float(m_currentSize);
+    return load > m_maxLoad || deleted > m_maxDeleted || m_newPolicy != m_currProbing || m_grow;
+}
+
+void VDetect::startRehash() {
+    COUNTSTAT(STATREHASHSTART, 1);
+#ifdef VDETECT_STATS
+    m_rehashStart = chrono::steady_clock::now();
+#endif
+    size_t cap = (m_currentSize - m_currNumDeleted) * 4;
+    if (m_grow) // the stash filled up at this size, a rebuild at the same size would collide the same way
+        cap = max(cap, m_currentCap * 2);
+    m_grown = m_grow;
+    m_grow = false;
+    moveCurrentToOld();
+    m_currProbing = m_newPolicy;
+    newCurrentTable(findNextCap(cap)); // set new current cap
+
+    vector<Slot> stashed; // the new table gets another chance at them
+    for (size_t i = 0; i < m_stashSize; i++)
+        stashed.push_back(std::move(m_stash[i]));
+    m_stashSize = 0;
+    for (size_t i = 0; i < stashed.size(); i++) { // the stash was just emptied, there is room for all of them
+        insertHelper(stashed[i]);
+        clearSlot(stashed[i]); // readers may still compare against the words the stash held
     }
+}
 
-    if (m_oldTable == nullptr) { // won't just rehash on an empty old table so that's why we need those other conditions
-        return;
+void VDetect::moveCurrentToOld() {
+    m_oldProbing = m_currProbing;
+    m_oldCap = m_currentCap;
+    m_oldTable = m_currentTable; // set old to the cur table
+    m_oldCtrl = m_currentCtrl;
+    m_oldOccupied = m_currentOccupied;
+    m_oldArena = m_currentArena;
+    m_oldFilter = m_currentFilter;
+    m_oldNumDeleted = m_currNumDeleted;
+    m_oldSize = m_currentSize;
+}
+
+void VDetect::newCurrentTable(size_t cap) {
+    m_currentCap = cap;
+    m_currNumDeleted = 0;
+    m_currentSize = 0;
+    m_currentTable = new Slot[m_currentCap]; // everything in there starts empty
+    m_currentCtrl = newCtrl(m_currentCap);
+    m_currentOccupied = newOccupancy(m_currentCap);
+    m_currentArena = new KeyArena(); // only keys that are still live get copied into it
+    m_currentFilter = m_prefilter ? new BloomFilter(m_currentCap) : nullptr; // removed keys are left behind
+    m_filterRemovals = 0;
+    m_cursor = 0;
+}
+
+void VDetect::rebuildTables() {
+    vector<Slot> entries; // copies own their key words, the arenas go away with the tables
+    entries.reserve(liveCount());
+    forEachLive([&](const Slot& slot) {entries.push_back(slot);});
+    if (m_oldTable != nullptr)
+        freeOldTable();
+
+    size_t cap = m_currentCap;
+    for (int attempt = 1; ; attempt++) {
+        for (size_t i = 0; i < m_stashSize; i++)
+            clearSlot(m_stash[i]);
+        m_stashSize = 0;
+        cap = findNextCap(cap * 2);
+        moveCurrentToOld();
+        freeOldTable();
+        newCurrentTable(cap);
+
+        bool last = attempt == REBUILDTRIES;
+        bool fits = true;
+        for (const Slot& entry : entries) {
+            if (insertHelper(entry))
+                continue;
+            fits = false;
+            if (!last)
+                break;
+            // more equal hashes than the stash holds, no capacity separates them
+            forgetSlot(entry);
+        }
+        if (fits || last)
+            break;
     }
+    m_grow = false;
+    m_grown = true;
+    endRehash();
+}
+
+void VDetect::forgetSlot(const Slot& slot) {
+    if (m_journal != nullptr)
+        m_journal->logRemove(slot.m_key, slot.m_id);
+    if (!m_byId.empty())
+        unindex(slot.m_key, slot.m_id);
+    if (m_hamming != nullptr)
+        m_hamming->remove(slot.m_key, slot.m_id);
+}
 
-    int counter = 0;
+void VDetect::migrate(size_t count) {
+    size_t counter = 0;
 
-    for (int i = 0; i < m_oldCap && counter < ceil(m_oldSize / 4); i++) { //first i is to go through the whole table, counter check if to make sure to get 25% of live nodes
-        if (!(m_oldTable[i] == EMPTY) && !(m_oldTable[i] == DELETED)) { // only live nodes are taken
-            insertHelper(m_oldTable[i]);
-            m_oldTable[i] = DELETED; // set to deleted
-            m_oldNumDeleted += 1;
+    // resumes at the cursor, nothing below it is live so the scan never repeats a slot
+    for (; m_cursor < m_oldCap && counter < count; m_cursor++) { // counter check if to make sure to get enough live nodes
+        if (m_oldCtrl[m_cursor] >= 0) { // only live nodes are taken
+            if (!migrateSlot(m_cursor))
+                return;
             counter += 1; // counter only goes up for live nodes
         }
     }
+    finishMigration();
+}
+
+void VDetect::migrateBounded() {
+    size_t end = m_oldCap;
+    if (m_slotBudget > 0 && m_cursor + m_slotBudget < end)
+        end = m_cursor + m_slotBudget;
+    bool timed = m_timeBudget.count() > 0;
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + m_timeBudget;
+
+    while (m_cursor < end) {
+        if (m_oldCtrl[m_cursor] >= 0 && !migrateSlot(m_cursor))
+            return;
+        m_cursor++;
+        // the clock is read once per 64 slots, the time budget is overrun by that much at most
+        if (timed && m_cursor % 64 == 0 && chrono::steady_clock::now() >= deadline)
+            break;
+    }
+    finishMigration();
+}
+
+bool VDetect::migrateSlot(size_t index) {
+    Slot& slot = m_oldTable[index];
+    if (!insertHelper(slot)) { // the new table and its stash are full on this probe sequence
+        rebuildTables();
+        return false;
+    }
+    COUNTSTAT(STATMIGRATED, 1);
+    clearSlot(slot); // set to deleted
+    setSlotCtrl(m_oldCtrl, m_oldCap, index, CTRLDELETED);
+    m_oldNumDeleted += 1;
+    return true;
+}
 
+void VDetect::finishMigration() {
     if (m_oldNumDeleted == m_oldSize) { // the amount of deleted should equal the size as the size are the live nodes so we are done
-        delete [] m_oldTable; // deallocate the old table
-        m_oldTable = nullptr;
+        freeOldTable(); // deallocate the old table
+        endRehash();
     }
+}
 
+void VDetect::endRehash() {
+#ifdef VDETECT_STATS
+    m_lastRehash = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_rehashStart);
+    m_stats.count(STATREHASHEND);
+    m_stats.count(STATREHASHNANOS, m_lastRehash.count());
+#endif
+    m_done.notify_all();
 }
 
-void VDetect::insertHelper(Virus virus) { // inserting the virus into an index depending on probing
-    int index;
+void VDetect::setMigrationBudget(size_t slots, chrono::microseconds time) {
+    unique_lock<mutex> guard = lockTables();
+    m_slotBudget = slots;
+    m_timeBudget = time;
+}
 
-    if (m_currProbing == NONE) {
-        index = m_hash(virus.m_key) % m_currentCap;
-        if (m_currentTable[index] == EMPTY || m_currentTable[index] == DELETED) { // can insert on deleted
-            m_currentTable[index] = virus; // insery at index you get from hash function equation
-            m_currentSize++;
+void VDetect::setRehashThresholds(float maxLoad, float maxDeleted) {
+    unique_lock<mutex> guard = lockTables();
+    m_maxLoad = maxLoad;
+    m_maxDeleted = maxDeleted;
+}
+
+void VDetect::setPrefilter(bool on) {
+    unique_lock<mutex> guard = lockTables();
+    m_prefilter = on;
+    if (on) {
+        buildFilters();
+        return;
+    }
+    delete m_currentFilter;
+    delete m_oldFilter;
+    m_currentFilter = nullptr;
+    m_oldFilter = nullptr;
+}
+
+void VDetect::buildFilters() {
+    delete m_currentFilter;
+    delete m_oldFilter;
+    m_currentFilter = nullptr;
+    m_oldFilter = nullptr;
+    m_filterRemovals = 0;
+    // filters of tables that already hold entries start from their live slots
+    m_currentFilter = new BloomFilter(m_currentCap);
+    for (size_t i = 0; i < m_currentCap; i++) {
+        if (m_currentCtrl[i] >= 0)
+            m_currentFilter->add(m_currentTable[i].m_hash);
+    }
+    if (m_oldTable != nullptr) {
+        m_oldFilter = new BloomFilter(m_oldCap);
+        for (size_t i = 0; i < m_oldCap; i++) {
+            if (m_oldCtrl[i] >= 0)
+                m_oldFilter->add(m_oldTable[i].m_hash);
         }
     }
+}
 
-    else if (m_currProbing == QUADRATIC) {
-        for (int i = 0; i < m_currentCap/2; ++i) { // for loop for equation purposes not for indexing of current table
-            index = ((m_hash(virus.m_key)) % m_currentCap) + (i * i) % m_currentCap;
-            if (m_currentTable[index] == EMPTY || m_currentTable[index] == DELETED){
-                m_currentTable[index] = virus;
-                m_currentSize++;
-                break;
-                //if (lambda() > 0.5 || m_oldTable != nullptr){
-                //rehash
-                //}
+void VDetect::setIdIndex(bool on) {
+    unique_lock<mutex> guard = lockTables();
+    m_byId.clear();
+    if (!on)
+        return;
+    m_byId.resize(MAXID - MINID + 1);
+    forEachLive([this](const Slot& slot) {m_byId[slot.m_id - MINID].push_back(slot.m_key);});
+}
+
+vector<Virus> VDetect::findById(int id) const {
+    unique_lock<mutex> guard = lockTables();
+    vector<Virus> found;
+    if (id < MINID || id > MAXID)
+        return found;
+    if (!m_byId.empty()) {
+        for (const PackedKey& key : m_byId[id - MINID])
+            found.push_back(Virus(key.toString(), id));
+        return found;
+    }
+    forEachLive([&](const Slot& slot) {
+        if (slot.m_id == id)
+            found.push_back(slot.toVirus());
+    });
+    return found;
+}
+
+size_t VDetect::countById(int id) const {
+    unique_lock<mutex> guard = lockTables();
+    if (id < MINID || id > MAXID)
+        return 0;
+    if (!m_byId.empty())
+        return m_byId[id - MINID].size();
+    size_t count = 0;
+    forEachLive([&](const Slot& slot) {count += slot.m_id == id;});
+    return count;
+}
+
+void VDetect::setHammingIndex(unsigned int k, unsigned int maxDistance) {
+    unique_lock<mutex> guard = lockTables();
+    delete m_hamming;
+    m_hamming = nullptr;
+    if (k == 0)
+        return;
+    m_hamming = new HammingIndex(k, maxDistance);
+    forEachLive([this](const Slot& slot) {m_hamming->add(slot.m_key, slot.m_id);});
+}
+
+vector<Virus> VDetect::findNear(string_view key, unsigned int distance) const {
+    unique_lock<mutex> guard = lockTables();
+    PackedKey packed(key);
+    vector<Virus> found;
+    if (!packed.isDna())
+        return found;
+    if (m_hamming != nullptr && m_hamming->length() == packed.length() && distance <= m_hamming->maxDistance()) {
+        m_hamming->near(packed, distance, [&](const PackedKey& near, const vector<int>& ids) {
+            string nearKey = near.toString();
+            for (int id : ids)
+                found.push_back(Virus(nearKey, id));
+        });
+        return found;
+    }
+    forEachLive([&](const Slot& slot) { // packed keys of one length line up word for word
+        if (slot.m_key.isDna() && slot.m_key.length() == packed.length() && withinDistance(slot.m_key, packed, distance))
+            found.push_back(slot.toVirus());
+    });
+    return found;
+}
+
+void VDetect::forEachLive(const function<void(const Slot&)>& visit) const {
+    for (const Slot& slot : *this)
+        visit(slot);
+}
+
+VDetect::Iterator VDetect::begin() const {
+    Iterator first(this);
+    first.settle();
+    return first;
+}
+
+VDetect::Iterator& VDetect::Iterator::operator++() {
+    m_index++;
+    settle();
+    return *this;
+}
+
+void VDetect::Iterator::settle() {
+    for (; m_part != PASTEND; m_part++, m_index = 0) {
+        if (m_part == CURRENT) {
+            m_index = nextOccupied(m_owner->m_currentOccupied, m_owner->m_currentCap, m_index);
+            if (m_index < m_owner->m_currentCap) {
+                m_slot = &m_owner->m_currentTable[m_index];
+                return;
             }
+        } else if (m_part == OLD && m_owner->m_oldTable != nullptr) {
+            m_index = nextOccupied(m_owner->m_oldOccupied, m_owner->m_oldCap, m_index);
+            if (m_index < m_owner->m_oldCap) {
+                m_slot = &m_owner->m_oldTable[m_index];
+                return;
+            }
+        } else if (m_part == STASH && m_index < m_owner->m_stashSize) {
+            m_slot = &m_owner->m_stash[m_index];
+            return;
         }
     }
+    m_slot = nullptr;
+}
 
-    else if (m_currProbing == DOUBLEHASH) {
-        for (int i = 0; i < m_currentCap; ++i) {
-            index = ((m_hash(virus.m_key) % m_currentCap) + i * (11 -(m_hash(virus.m_key) % 11))) % m_currentCap;
-            if (m_currentTable[index] == EMPTY || m_currentTable[index] == DELETED){
-                m_currentTable[index] = virus;
-                m_currentSize++;
-                break;
-                //if (lambda() > 0.5 || m_oldTable != nullptr){
-                //rehash
-                //}
+void VDetect::forEachParallel(const function<void(const Slot&)>& visit, unsigned int threads) const {
+    unique_lock<mutex> guard = lockTables();
+    struct Chunk{
+        const Slot*     table;
+        const uint64_t* occupied;
+        size_t          cap;
+        size_t          begin;
+        size_t          end;
+    };
+    vector<Chunk> chunks;
+    for (size_t begin = 0; begin < m_currentCap; begin += VISITCHUNK)
+        chunks.push_back(Chunk{m_currentTable, m_currentOccupied, m_currentCap, begin, min(begin + VISITCHUNK, m_currentCap)});
+    for (size_t begin = 0; m_oldTable != nullptr && begin < m_oldCap; begin += VISITCHUNK)
+        chunks.push_back(Chunk{m_oldTable, m_oldOccupied, m_oldCap, begin, min(begin + VISITCHUNK, m_oldCap)});
+
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    threads = min(size_t(threads), chunks.size());
+    atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t c = next++; c < chunks.size(); c = next++) {
+            const Chunk& chunk = chunks[c];
+            for (size_t i = nextOccupied(chunk.occupied, chunk.cap, chunk.begin); i < chunk.end;
+                 i = nextOccupied(chunk.occupied, chunk.cap, i + 1))
+                visit(chunk.table[i]);
+        }
+    };
+    vector<thread> workers;
+    for (unsigned int t = 1; t < threads; t++) // the calling thread is one of them
+        workers.emplace_back(work);
+    work();
+    for (thread& worker : workers)
+        worker.join();
+    for (size_t i = 0; i < m_stashSize; i++)
+        visit(m_stash[i]);
+}
+
+void VDetect::unindex(const PackedKey& key, int id) {
+    vector<PackedKey>& keys = m_byId[id - MINID];
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] == key) { // order does not matter, the last key fills the gap
+            keys[i] = std::move(keys.back());
+            keys.pop_back();
+            return;
+        }
+    }
+}
+
+void VDetect::setJournal(Journal* journal) {
+    unique_lock<mutex> guard = lockTables();
+    m_journal = journal;
+}
+
+void VDetect::migrateLoop() {
+    unique_lock<mutex> guard(m_lock);
+    while (!m_stop) {
+        if (m_oldTable == nullptr) {
+            m_wake.wait(guard);
+            continue;
+        }
+        migrate(MIGRATECHUNK);
+        guard.unlock(); // lets a foreground operation in between two chunks
+        this_thread::yield();
+        guard.lock();
+    }
+}
+
+void VDetect::setBackgroundRehash(bool on) {
+    if (on == m_background)
+        return;
+    if (on) {
+        m_stop = false;
+        m_background = true;
+        m_migrator = thread(&VDetect::migrateLoop, this);
+    } else {
+        {
+            lock_guard<mutex> guard(m_lock);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_migrator.join();
+        m_background = false; // a migration left behind continues a quarter per operation
+    }
+}
+
+void VDetect::waitForRehash() {
+    unique_lock<mutex> guard = lockTables();
+    if (m_background) {
+        m_done.wait(guard, [this]() {return m_oldTable == nullptr;});
+    } else if (m_oldTable != nullptr) {
+        migrate(m_oldSize);
+    }
+}
+
+bool VDetect::isRehashing() const {
+    unique_lock<mutex> guard = lockTables();
+    return m_oldTable != nullptr;
+}
+
+unique_lock<mutex> VDetect::lockTables() const {
+    if (m_background)
+        return unique_lock<mutex>(m_lock);
+    return unique_lock<mutex>();
+}
+
+void VDetect::setSlotCtrl(ctrl_t* ctrl, size_t cap, size_t index, ctrl_t value) {
+    setCtrl(ctrl, cap, index, value);
+    setOccupied(ctrl == m_currentCtrl ? m_currentOccupied : m_oldOccupied, index, value >= 0);
+}
+
+void VDetect::clearSlot(Slot& slot) {
+    if (m_epoch != nullptr) { // a reader may be comparing against the words right now
+        uint64_t* words = slot.m_key.releaseWords();
+        if (words != nullptr)
+            m_epoch->retire(words, deleteWords);
+    }
+    slot = DELETEDSLOT;
+}
+
+void VDetect::freeOldTable() {
+    Slot* table = m_oldTable;
+    ctrl_t* ctrl = m_oldCtrl;
+    KeyArena* arena = m_oldArena;
+    delete m_oldFilter; // lock-free readers never look at the filters or the occupancy bits
+    delete [] m_oldOccupied;
+    m_oldTable = nullptr; // unlinked before it is retired
+    m_oldCtrl = nullptr;
+    m_oldOccupied = nullptr;
+    m_oldArena = nullptr;
+    m_oldFilter = nullptr;
+    if (m_epoch != nullptr) {
+        m_epoch->retire(table, deleteSlots);
+        m_epoch->retire(ctrl, deleteCtrl);
+        m_epoch->retire(arena, deleteArena);
+    } else {
+        delete [] table;
+        delete [] ctrl;
+        delete arena;
+    }
+}
+
+bool VDetect::insertHelper(const Slot& slot) {
+    if (placeSlot(slot))
+        return true;
+    // a full probe sequence, the stash keeps the virus until the next rehash
+    COUNTSTAT(STATPROBEFAIL, 1);
+    return stashSlot(slot);
+}
+
+bool VDetect::placeSlot(const Slot& slot) { // inserting the virus into an index depending on probing
+    if (m_currentFilter != nullptr) // a stashed entry is added too, the stash is searched anyway
+        m_currentFilter->add(slot.m_hash);
+    if (m_currProbing == ROBINHOOD)
+        return robinHoodInsert(slot);
+    // the slot carries its hash, so migrated entries never go through hash_fn again
+    size_t index = findFreeIndex(m_currentCtrl, m_currentCap, m_currProbing, slot.m_hash);
+    if (index == NOSLOT && m_currProbing == CUCKOO) {
+        index = cuckooEvict(slot.m_hash);
+    }
+
+    if (index != NOSLOT) { // can insert on empty or deleted
+        m_currentTable[index] = arenaSlot(slot);
+        setSlotCtrl(m_currentCtrl, m_currentCap, index, hashFragment(slot.m_hash));
+        m_currentSize++;
+        return true;
+    }
+    return false;
+}
+
+size_t VDetect::cuckooEvict(unsigned int hash) {
+    struct Step{
+        size_t bucket;
+        int    parent;  // step whose bucket the entry moving here comes from, -1 for the key's own buckets
+        int    way;     // slot of the parent bucket holding that entry
+    };
+    vector<Step> steps;
+    size_t first, second;
+    cuckooBucketsOf(hash, first, second);
+    steps.push_back(Step{first, -1, -1});
+    steps.push_back(Step{second, -1, -1});
+
+    // breadth first, so the path found moves the fewest entries
+    for (size_t n = 0; n < steps.size(); n++) {
+        size_t bucket = steps[n].bucket;
+        for (int way = 0; way < BUCKETWAYS; way++) {
+            size_t free = bucket * BUCKETWAYS + way;
+            if (m_currentCtrl[free] >= 0)
+                continue;
+            // walks back to the key's bucket, every entry moves into the slot its successor left
+            for (int at = int(n); steps[at].parent >= 0; at = steps[at].parent) {
+                size_t from = steps[steps[at].parent].bucket * BUCKETWAYS + steps[at].way;
+                m_currentTable[free] = std::move(m_currentTable[from]);
+                setSlotCtrl(m_currentCtrl, m_currentCap, free, m_currentCtrl[from]);
+                m_currentTable[from] = Slot();
+                setSlotCtrl(m_currentCtrl, m_currentCap, from, CTRLEMPTY);
+                free = from;
             }
+            return free;
+        }
+        for (int way = 0; way < BUCKETWAYS && steps.size() < CUCKOOSEARCH; way++) {
+            size_t other;
+            cuckooBucketsOf(m_currentTable[bucket * BUCKETWAYS + way].m_hash, first, second);
+            other = first == bucket ? second : first;
+            bool onPath = false; // a bucket may only appear once on a path
+            for (int at = int(n); at >= 0 && !onPath; at = steps[at].parent)
+                onPath = steps[at].bucket == other;
+            if (!onPath)
+                steps.push_back(Step{other, int(n), way});
         }
     }
-    // only inserts on current table
-}
\ No newline at end of file
+    return NOSLOT;
+}
+
+void VDetect::cuckooBucketsOf(unsigned int hash, size_t& first, size_t& second) const {
+    if (m_capMode == POW2CAP)
+        cuckooBuckets<POW2CAP>(hash, m_currentCap, first, second);
+    else
+        cuckooBuckets<PRIMECAP>(hash, m_currentCap, first, second);
+}
+
+bool VDetect::stashSlot(const Slot& slot) {
+    bool stashed = m_stashSize < STASHSIZE;
+    COUNTSTAT(stashed ? STATSTASHED : STATDROPPED, 1);
+    if (stashed)
+        m_stash[m_stashSize++] = slot;
+    // grows once per table, when a doubled table fills the stash too the keys share their probe
+    // sequence (one key with many IDs, or equal hashes) and a bigger table would not help
+    if (m_stashSize == STASHSIZE && !m_grown)
+        m_grow = true;
+    return stashed;
+}
+
+Slot VDetect::arenaSlot(const Slot& slot) {
+    return Slot(m_currentArena->store(slot.m_key), slot.m_id, slot.m_hash);
+}
+
+bool VDetect::robinHoodInsert(const Slot& slot) {
+    // a ROBINHOOD table has no DELETED slots, so it has an EMPTY one unless every slot is live;
+    // checked before any swap, a walk that found no room would be carrying a stored entry by then
+    if (m_currentSize >= m_currentCap)
+        return false;
+    Slot carried = arenaSlot(slot);
+    size_t pos = homeIndex(carried.m_hash, m_currentCap);
+    size_t distance = 0; // of carried from its home slot
+    for (size_t probe = 0; probe < m_currentCap; probe++) {
+        if (m_currentCtrl[pos] == CTRLEMPTY) {
+            m_currentTable[pos] = std::move(carried);
+            setSlotCtrl(m_currentCtrl, m_currentCap, pos, hashFragment(m_currentTable[pos].m_hash));
+            m_currentSize++;
+            return true;
+        }
+        size_t theirs = probeDistance(homeIndex(m_currentTable[pos].m_hash, m_currentCap), pos, m_currentCap);
+        if (theirs < distance) { // the richer entry makes room and is placed further on
+            swap(carried, m_currentTable[pos]);
+            setSlotCtrl(m_currentCtrl, m_currentCap, pos, hashFragment(m_currentTable[pos].m_hash));
+            distance = theirs;
+        }
+        pos = pos + 1 == m_currentCap ? 0 : pos + 1;
+        distance++;
+    }
+    return false; // not reached, the walk visits every slot
+}
+
+void VDetect::backwardShift(size_t index) {
+    clearSlot(m_currentTable[index]);
+    size_t hole = index;
+    size_t next = hole + 1 == m_currentCap ? 0 : hole + 1;
+    while (m_currentCtrl[next] != CTRLEMPTY &&
+           homeIndex(m_currentTable[next].m_hash, m_currentCap) != next) {
+        m_currentTable[hole] = std::move(m_currentTable[next]);
+        setSlotCtrl(m_currentCtrl, m_currentCap, hole, m_currentCtrl[next]);
+        hole = next;
+        next = hole + 1 == m_currentCap ? 0 : hole + 1;
+    }
+    m_currentTable[hole] = Slot();
+    setSlotCtrl(m_currentCtrl, m_currentCap, hole, CTRLEMPTY);
+}
+
+size_t VDetect::homeIndex(unsigned int hash, size_t cap) const {
+    if (m_capMode == POW2CAP)
+        return homeSlot<POW2CAP>(hash, cap);
+    return homeSlot<PRIMECAP>(hash, cap);
+}
+
+size_t VDetect::findIndex(const Slot* table, const ctrl_t* ctrl, size_t cap, prob_t probing,
+                          unsigned int hash, const PackedKey& key, int id) const {
+    size_t index = withPolicy(probing, m_capMode, [&](auto policy) { // one branch on the policy, the loop is inlined
+        typedef decltype(policy) P;
+        return probeFind<typename P::Probe, P::mode>(table, ctrl, cap, hash,
+            [&](const Slot& slot) {return slot.matches(key, id, hash);});
+    });
+    COUNTPROBE(table == m_currentTable ? 0 : 1);
+    return index;
+}
+
+size_t VDetect::findFreeIndex(const ctrl_t* ctrl, size_t cap, prob_t probing, unsigned int hash) const {
+    return withPolicy(probing, m_capMode, [&](auto policy) {
+        typedef decltype(policy) P;
+        return probeFree<typename P::Probe, P::mode>(ctrl, cap, hash);
+    });
+}
@@ -2,23 +2,51 @@
 #define VDETECT_H
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <optional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <iterator>
 #include "math.h"
+#include "packedkey.h"
+#include "keyarena.h"
+#include "bloomfilter.h"
+#include "hammingindex.h"
+#include "opstats.h"
+#include "probing.h"
 using namespace std;
 class Grader;   // forward declaration, will be used for grdaing
 class Tester;   // forward declaration, will be used for testing
 class Virus;    // forward declaration
+class Slot;     // forward declaration
 class VDetect;  // forward declaration
+class EpochDomain; // forward declaration
+class Journal;  // forward declaration
 const int MINID = 1000;
 const int MAXID = 9999;
 const int MINPRIME = 101;   // Min size for hash table
-const int MAXPRIME = 99991; // Max size for hash table
-#define EMPTY Virus("",0)
-#define DELETED Virus("DELETED")
+const int MINPOW2 = 128;    // Min size for a power of two hash table
+const float DEFMAXLOAD = 0.5;   // load factor that starts a rehash
+const float DEFMAXDELETED = 0.8;// deleted ratio that starts a rehash
+const int MIGRATECHUNK = 64;// live entries the background thread moves per hold of the table lock
+const int STASHSIZE = 8;    // entries kept aside when the probe sequence or cuckoo path of an insert fails
+const int REBUILDTRIES = 4; // doublings a rebuild tries before it gives up on entries no table size separates
+const int CUCKOOSEARCH = 256;// buckets a cuckoo insert searches for an eviction path
+const int PREFETCHAHEAD = 8;// keys of a batch between the prefetch of a home slot and its probe
+const int VISITCHUNK = 4096;// slots of one table a forEachParallel thread takes at a time
+// live entries of the old table one operation migrates, a quarter of its entries rounded up
+inline size_t migrationBudget(size_t oldSize) {return (oldSize + 3) / 4;}
+#define EMPTY EMPTYVIRUS         // built once, see below the Virus class
+#define DELETED DELETEDVIRUS
 #define DELETEDKEY "DELETED"
 
 typedef unsigned int (*hash_fn)(string);    // declaration of hash function
-enum prob_t {NONE, QUADRATIC, DOUBLEHASH};  // types of collision handling policy
 #define DEFPOLCY QUADRATIC
+#define DEFCAP PRIMECAP
 
 const int MAX = 4;
 const char ALPHA[MAX] = {'A', 'C', 'G', 'T'};
@@ -28,8 +56,11 @@ public:
     friend class Grader;
     friend class Tester;
     friend class VDetect;
-    Virus(string key="", int id=0){m_key = key; m_id = id;}
-    string getKey() const {return m_key;}
+    Virus(string key="", int id=0) : m_key(std::move(key)), m_id(id) {}
+    Virus(const Virus& rhs) = default;
+    Virus(Virus&& rhs) noexcept = default;
+    Virus& operator=(Virus&& rhs) noexcept = default;
+    const string& getKey() const {return m_key;}
     int getID() const {return m_id;}
     void setKey(string key){m_key=key;}
     void setID(int id){m_id=id;}
@@ -48,52 +79,308 @@ private:
     string m_key;   // the search string used as key in the hash table
     int m_id;       // a unique ID number identifying the object
 };
+inline const Virus EMPTYVIRUS("", 0);
+inline const Virus DELETEDVIRUS(DELETEDKEY);
+
+// a hash table entry, keeps the key in its packed form
+// EMPTY and DELETED slots are the ones with ID 0
+class Slot{
+public:
+    friend class Grader;
+    friend class Tester;
+    friend class VDetect;
+    friend class ConcurrentVDetect;
+    friend class MappedVDetect;
+    template <class Probe, class Hasher> friend class StaticVDetect;
+    Slot(){m_id = 0; m_hash = 0;}
+    Slot(const PackedKey& key, int id, unsigned int hash = 0) : m_key(key), m_id(id), m_hash(hash) {}
+    Slot(PackedKey&& key, int id, unsigned int hash) : m_key(std::move(key)), m_id(id), m_hash(hash) {}
+    explicit Slot(const Virus& virus) : m_key(virus.getKey()), m_id(virus.getID()), m_hash(0) {}
+    // rebuilds the user object stored in the slot
+    Virus toVirus() const {return Virus(m_key.toString(), m_id);}
+    bool isLive() const {return m_id != 0;}
+    const PackedKey& getKey() const {return m_key;}
+    int getID() const {return m_id;}
+    bool matches(const PackedKey& key, int id) const {return m_id == id && m_key == key;}
+    // the cached hash filters out almost every mismatch before the key is read
+    bool matches(const PackedKey& key, int id, unsigned int hash) const {
+        return m_hash == hash && m_id == id && m_key == key;
+    }
+    // the same for any ID
+    bool matchesKey(const PackedKey& key, unsigned int hash) const {return m_hash == hash && m_key == key;}
+    // Overloaded insertion operator
+    friend ostream& operator<<(ostream& sout, const Slot &slot );
+    // Overloaded equality operator, compares a slot against a user object
+    friend bool operator==(const Slot& lhs, const Virus& rhs);
+private:
+    PackedKey m_key;    // 2 bits per base for DNA keys
+    int m_id;           // the ID of the stored virus
+    unsigned int m_hash;// hash_fn value of the key, computed once on insert
+};
 
 class VDetect{
 public:
     friend class Grader;
     friend class Tester;
-    VDetect(int size, hash_fn hash, prob_t probing);
+    friend class ConcurrentVDetect;
+    friend class MappedVDetect;
+    friend class Journal;
+    friend class KmerScanner;
+    // forward iterator over the live entries of the current table, the old table and the stash,
+    // in that order; the occupancy bits of a table let it jump over EMPTY and DELETED slots 64 at a
+    // time. It takes no lock and is invalidated by the next insert or remove, so with the background
+    // rehash on it is only used after waitForRehash, before the next write
+    class Iterator{
+    public:
+        friend class VDetect;
+        typedef forward_iterator_tag iterator_category;
+        typedef Slot value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const Slot* pointer;
+        typedef const Slot& reference;
+        Iterator() : m_owner(nullptr), m_part(PASTEND), m_index(0), m_slot(nullptr) {}
+        const Slot& operator*() const {return *m_slot;}
+        const Slot* operator->() const {return m_slot;}
+        Iterator& operator++();
+        Iterator operator++(int){Iterator before = *this; ++*this; return before;}
+        bool operator==(const Iterator& rhs) const {return m_slot == rhs.m_slot;}
+        bool operator!=(const Iterator& rhs) const {return m_slot != rhs.m_slot;}
+    private:
+        enum Part {CURRENT, OLD, STASH, PASTEND};
+        Iterator(const VDetect* owner) : m_owner(owner), m_part(CURRENT), m_index(0), m_slot(nullptr) {}
+        // moves to the first live entry at or after m_index of m_part
+        void settle();
+        const VDetect* m_owner;
+        int m_part;         // where m_slot is
+        size_t m_index;     // slot of the table or stash entry m_slot is
+        const Slot* m_slot; // nullptr past the end
+    };
+    VDetect(size_t size, hash_fn hash, prob_t probing, cap_t capacity = DEFCAP);
     ~VDetect();
     // Returns Load factor of the new table
     float lambda() const;
     // Returns the ratio of deleted slots in the new table
     float deletedRatio() const;
     // insert only happens in the new table
-    bool insert(Virus virus);
+    bool insert(const Virus& virus);
+    // insert without building a Virus, the key is packed straight from the view
+    bool emplace(string_view key, int id);
     // remove can happen from either table
-    bool remove(Virus virus);
+    bool remove(const Virus& virus);
     // find can happen in either table
-    Virus getVirus(string key, int id) const;
+    Virus getVirus(const string& key, int id) const;
+    // lookups that allocate nothing on a miss: contains never builds a string,
+    // findEntry points at the slot and stays valid until the next insert or remove
+    bool contains(string_view key, int id) const;
+    const Slot* findEntry(string_view key, int id) const;
+    optional<Virus> findVirus(string_view key, int id) const;
+    // a live slot holding key under any ID, nullptr if there is none
+    const Slot* findKey(string_view key) const;
+    // every ID stored with key; all of them sit on the probe sequence of the key's hash, so one
+    // walk per table collects them. GroupedVDetect keeps them in one slot instead
+    vector<int> findAll(string_view key) const;
+    // batched insert, remove and getVirus, same results as calling them one key at a time;
+    // every key is packed and hashed first and the home slots of later keys are prefetched
+    // while earlier ones are probed, so the cache misses of a batch overlap
+    size_t insertBatch(const vector<Virus>& viruses);
+    size_t removeBatch(const vector<Virus>& viruses);
+    vector<Virus> getVirusBatch(const vector<Virus>& queries) const;
     // request a change in collision handling policy
     void changeProbPolicy(prob_t policy);
     // dumps the contents of the two tables
     void dump() const;
+    // live entries only, see Iterator
+    Iterator begin() const;
+    Iterator end() const {return Iterator();}
+    // calls visit for every live entry, the tables are cut into chunks of VISITCHUNK slots that
+    // threads (hardware threads for 0) take in turn, so visit is called from several threads at once;
+    // the stash is visited last, by the calling thread
+    void forEachParallel(const function<void(const Slot&)>& visit, unsigned int threads = 0) const;
+    // when on, entries are moved from the old table by a background thread instead of a quarter per
+    // insert/remove; every public function then takes the table lock the thread works under
+    void setBackgroundRehash(bool on);
+    // returns once the old table is fully migrated, migrates it right away when the mode is off
+    void waitForRehash();
+    // true while the old table still holds entries
+    bool isRehashing() const;
+    // bounds the migration work of one insert/remove to a number of old table slots, scanned
+    // or not, and/or a time; 0 for both restores moving a quarter of the live entries per operation
+    void setMigrationBudget(size_t slots, chrono::microseconds time = chrono::microseconds(0));
+    // load factor and deleted ratio above which a rehash starts
+    void setRehashThresholds(float maxLoad, float maxDeleted);
+    // every successful insert/remove from now on is logged to journal, nullptr stops logging
+    void setJournal(Journal* journal);
+    // when on, each table keeps a Bloom filter of its key hashes and lookups skip a table
+    // whose filter rules the key out, so most misses cost one cache line instead of a probe
+    void setPrefilter(bool on);
+    // when on, a posting list of the keys of every ID is kept next to the tables, so findById
+    // reads one list instead of scanning both tables
+    void setIdIndex(bool on);
+    // every live entry with id, any order; scans the tables when the index is off
+    vector<Virus> findById(int id) const;
+    size_t countById(int id) const;
+    // when k > 0, the DNA keys of k bases are kept in a HammingIndex for findNear queries of up to
+    // maxDistance mismatches; k 0 drops the index
+    void setHammingIndex(unsigned int k, unsigned int maxDistance);
+    // every entry whose key is a DNA key of the query's length within distance mismatches of it,
+    // the exact key included; without an index for that length and distance the tables are scanned
+    vector<Virus> findNear(string_view key, unsigned int distance) const;
+    // counters, probe length histograms, rehash timing and memory use; the counters are only kept
+    // when built with VDETECT_STATS, each thread adds to its own so counting takes no lock
+    VDetectStats stats() const;
 
 private:
     hash_fn    m_hash;          // hash function
     prob_t     m_newPolicy;     // stores the change of policy request
+    cap_t      m_capMode;       // prime or power of two capacities for both tables
 
-    Virus*     m_currentTable;  // hash table
-    int        m_currentCap;    // hash table size (capacity)
-    int        m_currentSize;   // current number of entries
+    Slot*      m_currentTable;  // hash table
+    ctrl_t*    m_currentCtrl;   // control byte of every slot
+    uint64_t*  m_currentOccupied;// bit of every slot, set for live slots, see setSlotCtrl
+    size_t     m_currentCap;    // hash table size (capacity)
+    size_t     m_currentSize;   // current number of entries
     // m_currentSize includes deleted entries
-    int        m_currNumDeleted;// number of deleted entries
+    size_t     m_currNumDeleted;// number of deleted entries
     prob_t     m_currProbing;   // collision handling policy
+    KeyArena*  m_currentArena;  // words of the long keys in m_currentTable
+    BloomFilter* m_currentFilter; // key hashes in m_currentTable, nullptr without a prefilter
 
-    Virus*     m_oldTable;      // hash table
-    int        m_oldCap;        // hash table size (capacity)
-    int        m_oldSize;       // current number of entries
+    Slot*      m_oldTable;      // hash table
+    ctrl_t*    m_oldCtrl;       // control byte of every slot
+    uint64_t*  m_oldOccupied;   // bit of every slot, set for live slots
+    size_t     m_oldCap;        // hash table size (capacity)
+    size_t     m_oldSize;       // current number of entries
     // m_oldSize includes deleted entries
-    int        m_oldNumDeleted; // number of deleted entries
+    size_t     m_oldNumDeleted; // number of deleted entries
     prob_t     m_oldProbing;    // collision handling policy
+    KeyArena*  m_oldArena;      // words of the long keys in m_oldTable
+    BloomFilter* m_oldFilter;   // key hashes in m_oldTable
+
+    size_t     m_cursor;        // old table slots below it are all migrated or deleted
+    size_t     m_slotBudget;    // old slots scanned per operation, 0 for no slot bound
+    chrono::microseconds m_timeBudget; // migration time per operation, 0 for no time bound
+    float      m_maxLoad;       // rehash triggers
+    float      m_maxDeleted;
+
+    Slot       m_stash[STASHSIZE]; // entries no probe sequence had room for, a rehash reinserts them
+    size_t     m_stashSize;
+    bool       m_grow;          // the stash filled up, the next rehash at least doubles the capacity
+    bool       m_grown;         // the current table came from such a rehash, it does not ask again
+
+    EpochDomain* m_epoch;       // set when readers probe without a lock, frees go through it
+    Journal*   m_journal;       // write-ahead log of inserts and removes, nullptr when not logging
+    bool       m_prefilter;     // new tables get a BloomFilter
+    size_t     m_filterRemovals;// removes since the current filter was built, their keys still pass it
+    vector<vector<PackedKey>> m_byId; // keys of every ID at id - MINID, empty when the index is off
+    HammingIndex* m_hamming;    // nullptr when there is no index for findNear
+
+#ifdef VDETECT_STATS
+    mutable StatsRegistry m_stats;
+    chrono::steady_clock::time_point m_rehashStart;
+    chrono::nanoseconds m_lastRehash;   // length of the last finished rehash
+#endif
+    bool       m_background;    // migration runs on m_migrator
+    bool       m_stop;          // asks m_migrator to return
+    thread     m_migrator;
+    mutable mutex m_lock;       // guards both tables while m_migrator runs
+    condition_variable m_wake;  // a rehash started or m_stop was set
+    condition_variable m_done;  // the old table was freed
 
     //private helper functions
-    bool isPrime(int number);
-    int findNextPrime(int current);
+    bool isPrime(size_t number);
+    size_t findNextPrime(size_t current);
+    // smallest power of two above current, never below MINPOW2
+    size_t findNextPow2(size_t current);
+    // capacity of a new table holding current entries, depends on m_capMode
+    size_t findNextCap(size_t current);
 
     void rehashHelper();
-    void insertHelper(Virus virus);
+    // a rehash is due, by load factor, deleted ratio or a policy change
+    bool needsRehash() const;
+    // moves the current table to the old one and allocates the new current table
+    void startRehash();
+    void moveCurrentToOld();
+    // allocates an empty current table of cap slots
+    void newCurrentTable(size_t cap);
+    // replaces the filters of both tables with ones built from their live slots
+    void buildFilters();
+    // moves every live entry into a new table of at least twice the capacity, doubling again until
+    // they all fit; used when a migration finds no room for an entry that was already stored
+    void rebuildTables();
+    // takes an entry no table could hold out of the journal and the indexes, stashSlot counted it dropped
+    void forgetSlot(const Slot& slot);
+    // moves up to count live entries of the old table, frees it once it is empty
+    void migrate(size_t count);
+    // migrates within the slot and time budget
+    void migrateBounded();
+    // moves the live old table slot at index into the current table, false when that took a
+    // rebuildTables and the migration is over
+    bool migrateSlot(size_t index);
+    // frees the old table once every entry left it
+    void finishMigration();
+    // wakes waitForRehash once the old table is gone
+    void endRehash();
+    // body of m_migrator
+    void migrateLoop();
+    // locked when the background mode is on, unlocked otherwise
+    unique_lock<mutex> lockTables() const;
+    // places an entry in the current table or the stash, false when neither had room
+    bool insertHelper(const Slot& slot);
+    // the same without the stash, false when the probe sequence had no room
+    bool placeSlot(const Slot& slot);
+    // slot with its key words copied into the arena of the current table
+    Slot arenaSlot(const Slot& slot);
+    // ROBINHOOD insert into the current table, an entry closer to its home slot than the one
+    // being placed gives up its slot and is carried on
+    bool robinHoodInsert(const Slot& slot);
+    // ROBINHOOD remove from the current table, the entries after index move one slot back
+    // until one is at its home slot or the run ends, no DELETED slot is left behind
+    void backwardShift(size_t index);
+    // CUCKOO insert into the current table when both buckets of hash are full: entries are moved
+    // along the shortest path to a free slot and the freed slot of hash's buckets is returned
+    size_t cuckooEvict(unsigned int hash);
+    // the two cuckoo buckets of a hash in the current table
+    void cuckooBucketsOf(unsigned int hash, size_t& first, size_t& second) const;
+    // keeps an entry that found no slot, false when the stash is full; a stash that fills up
+    // makes the next rehash grow the table instead of rebuilding it at the same size
+    bool stashSlot(const Slot& slot);
+    // home slot of a hash in a table of cap slots
+    size_t homeIndex(unsigned int hash, size_t cap) const;
+    // setCtrl for a slot of either table, keeps the occupancy bits of the table in step
+    void setSlotCtrl(ctrl_t* ctrl, size_t cap, size_t index, ctrl_t value);
+    // turns a live slot into a DELETED one, its key words are retired when readers may hold them
+    void clearSlot(Slot& slot);
+    // frees the old table once it is fully migrated
+    void freeOldTable();
+
+    // hashes a key once per operation, packed keys skip the string when packedHashCode is used
+    unsigned int hashKey(string_view key, const PackedKey& packed) const;
+    // insert and remove for a key that is already packed and hashed
+    bool insertPacked(const PackedKey& packed, unsigned int hash, int id);
+    bool removePacked(const PackedKey& packed, unsigned int hash, int id);
+    // removes key/id from whichever table or the stash holds it
+    bool eraseEntry(const PackedKey& packed, unsigned int hash, int id);
+    // packs and hashes every key of a batch
+    void packBatch(const vector<Virus>& viruses, vector<PackedKey>& packed, vector<unsigned int>& hashes) const;
+    // starts loading the control byte and slot a probe for hash reads first, in both tables
+    void prefetchHome(unsigned int hash) const;
+    // number of live entries in both tables
+    size_t liveCount() const;
+    // returns the live slot holding key/id in either table or nullptr
+    const Slot* findSlot(const PackedKey& key, unsigned int hash, int id) const;
+    // findSlot for a user lookup, counted in the stats
+    const Slot* lookupSlot(const PackedKey& key, unsigned int hash, int id) const;
+    // the same for any ID
+    const Slot* findKeySlot(const PackedKey& key, unsigned int hash) const;
+    // calls visit for every live slot of both tables and the stash
+    void forEachLive(const function<void(const Slot&)>& visit) const;
+    // drops key from the posting list of id
+    void unindex(const PackedKey& key, int id);
+    // returns the index of the live slot holding key/id or NOSLOT if it is not in the table
+    size_t findIndex(const Slot* table, const ctrl_t* ctrl, size_t cap, prob_t probing,
+                     unsigned int hash, const PackedKey& key, int id) const;
+    // returns the first EMPTY or DELETED slot on the probe sequence or NOSLOT if there is none
+    size_t findFreeIndex(const ctrl_t* ctrl, size_t cap, prob_t probing, unsigned int hash) const;
 
 
     /******************************************